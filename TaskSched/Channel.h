@@ -0,0 +1,157 @@
+/*
+ * Typed single-producer, single-consumer channels between tasks.
+ */
+
+/*
+ * A lock-free ring of N values of type T from one producer - a task, an
+ * ISR or another thread - to one consumer, a TriggeredTask bound to the
+ * channel and triggered by every send:
+ *
+ *     Channel<uint16_t, 8> readings;
+ *     readings.bind(alarm);
+ *
+ *     // Producer.
+ *     if (!readings.send(analogRead(pin))) { ... full ... }
+ *
+ *     // Consumer's run() - reset first, so a send during the drain isn't missed.
+ *     resetRunnable();
+ *     while (uint16_t *level = readings.peek()) {
+ *         ...
+ *         readings.release();
+ *     }
+ *
+ * N must be a power of 2.
+ */
+
+#ifndef Channel_h
+#define Channel_h
+
+#include "Task.h"
+#include "TaskAtomic.h"
+
+template <typename T, unsigned N>
+class Channel {
+
+    static_assert(N && (N & (N - 1)) == 0, "Channel: N must be a power of 2");
+
+public:
+    inline Channel() : head(0), tail(0), rejected(0), waiting(false), consumer(0), producer(0) {}
+
+    /*
+     * Set the task to trigger whenever a value is sent.
+     */
+    inline void bind(TriggeredTask &task) { consumer = &task; }
+
+    /*
+     * Set a task to trigger when a slot frees up after a failed send.
+     */
+    inline void bindProducer(TriggeredTask &task) { producer = &task; }
+
+    /*
+     * Get the next free slot to fill.  Producer only.
+     * return - the slot, or NULL if the channel is full.
+     */
+    inline T *reserve() {
+        unsigned h = head;
+        if (h - taskAtomicLoad(&tail) >= N) {
+            // Flag the wait, then look again: a release() since the first
+            // look either sees the flag and triggers the producer, or freed
+            // a slot that this second look sees.
+            taskAtomicExchange(&waiting, true);
+            if (h - taskAtomicLoad(&tail) >= N) {
+                taskAtomicAdd(&rejected, (uint32_t)1);
+                return 0;
+            }
+        }
+        return &slots[h & (N - 1)];
+    }
+
+    /*
+     * Publish the slot from reserve() and trigger the consumer.  Producer
+     * only.
+     */
+    inline void commit() {
+        taskAtomicStore(&head, head + 1);
+        if (consumer) {
+            consumer->setRunnable();
+        }
+    }
+
+    /*
+     * Copy a value into the channel.  Producer only.
+     * return - false if the channel was full.
+     */
+    inline bool send(const T &value) {
+        T *slot = reserve();
+        if (!slot) {
+            return false;
+        }
+        *slot = value;
+        commit();
+        return true;
+    }
+
+    /*
+     * Can a value be sent?  Producer only.
+     */
+    inline bool canSend() { return head - taskAtomicLoad(&tail) < N; }
+
+    /*
+     * Get the oldest value, in place.  Consumer only.
+     * return - the value, or NULL if the channel is empty.
+     */
+    inline T *peek() {
+        unsigned t = tail;
+        if (taskAtomicLoad(&head) == t) {
+            return 0;
+        }
+        return &slots[t & (N - 1)];
+    }
+
+    /*
+     * Free the slot of the value from peek().  Consumer only.
+     */
+    inline void release() {
+        taskAtomicStore(&tail, tail + 1);
+        if (producer && taskAtomicExchange(&waiting, false)) {
+            producer->setRunnable();
+        }
+    }
+
+    /*
+     * Copy the oldest value out of the channel.  Consumer only.
+     * return - false if the channel was empty.
+     */
+    inline bool receive(T &value) {
+        T *slot = peek();
+        if (!slot) {
+            return false;
+        }
+        value = *slot;
+        release();
+        return true;
+    }
+
+    /*
+     * Get the number of values waiting.
+     */
+    inline unsigned getCount() { return taskAtomicLoad(&head) - taskAtomicLoad(&tail); }
+
+    inline bool isEmpty() { return getCount() == 0; }
+
+    /*
+     * Get the number of sends that failed because the channel was full.
+     */
+    inline uint32_t getRejected() { return taskAtomicLoad(&rejected); }
+
+private:
+    T slots[N];                 // The ring.
+    volatile unsigned head;     // Values sent - producer only writes it.
+    volatile unsigned tail;     // Values received - consumer only writes it.
+    volatile uint32_t rejected; // Sends that found the channel full.
+    volatile bool waiting;      // A send has failed since the last release.
+    TriggeredTask *consumer;    // Triggered by each send.
+    TriggeredTask *producer;    // Triggered when a failed send can retry.
+};
+
+#endif
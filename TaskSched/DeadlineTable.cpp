@@ -0,0 +1,149 @@
+/*
+ * TimedTask run times kept in a contiguous array, scanned with SIMD.
+ */
+
+#include "DeadlineTable.h"
+
+#if defined(TASK_DEADLINE_TABLE)
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+DeadlineTable::DeadlineTable(task_time_t *_times, task_count_t *_priorities,
+  TimedTask **_tasks, task_count_t _capacity) :
+  times(_times),
+  priorities(_priorities),
+  tasks(_tasks),
+  capacity(_capacity),
+  count(0) {
+}
+
+bool DeadlineTable::add(TimedTask *task) {
+    if (count >= capacity) {
+        return false;
+    }
+    // After any of the same priority, shifting the rest up.
+    task_count_t at = seek(task->priority + 1);
+    for (task_count_t i = count; i > at; i--) {
+        move(i, i - 1);
+    }
+    count++;
+    times[at] = task->runTime;
+    priorities[at] = task->priority;
+    tasks[at] = task;
+    task->tableEntry = &times[at];
+    return true;
+}
+
+void DeadlineTable::remove(TimedTask *task) {
+    task_count_t at = task->tableEntry - times;
+    task->tableEntry = 0;
+    count--;
+    for (task_count_t i = at; i < count; i++) {
+        move(i, i + 1);
+    }
+}
+
+void DeadlineTable::move(task_count_t to, task_count_t from) {
+    times[to] = times[from];
+    priorities[to] = priorities[from];
+    tasks[to] = tasks[from];
+    tasks[to]->tableEntry = &times[to];
+}
+
+task_count_t DeadlineTable::seek(task_count_t priority) {
+    // Binary search - the priorities are in ascending order.
+    task_count_t lo = 0;
+    task_count_t hi = count;
+    while (lo < hi) {
+        task_count_t mid = lo + (hi - lo) / 2;
+        if (priorities[mid] < priority) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * An entry is due when now - time, taken as signed, isn't negative - the
+ * same wrap-safe test as taskTimeReached().  The vector loops subtract a
+ * whole vector of run times from the clock, and gather the sign bits into a
+ * mask of entries not yet due.
+ */
+task_count_t DeadlineTable::findDue(task_time_t now, task_count_t from) {
+    task_count_t i = from;
+
+#if TASK_TIME_BITS == 32
+#if defined(__AVX2__)
+    __m256i nowv = _mm256_set1_epi32((int)now);
+    for (; i + 8 <= count; i += 8) {
+        __m256i t = _mm256_loadu_si256((const __m256i *)&times[i]);
+        int waiting = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_sub_epi32(nowv, t)));
+        if (waiting != 0xFF) {
+            return i + __builtin_ctz(~waiting);
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i nowv = _mm_set1_epi32((int)now);
+    for (; i + 4 <= count; i += 4) {
+        __m128i t = _mm_loadu_si128((const __m128i *)&times[i]);
+        int waiting = _mm_movemask_ps(_mm_castsi128_ps(_mm_sub_epi32(nowv, t)));
+        if (waiting != 0xF) {
+            return i + __builtin_ctz(~waiting);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint32x4_t nowv = vdupq_n_u32(now);
+    for (; i + 4 <= count; i += 4) {
+        // All ones in each lane that is due.
+        uint32x4_t due = vcgeq_s32(vreinterpretq_s32_u32(vsubq_u32(nowv, vld1q_u32(&times[i]))), vdupq_n_s32(0));
+        if (vmaxvq_u32(due)) {
+            break;
+        }
+    }
+#endif
+#else
+#if defined(__AVX2__)
+    __m256i nowv = _mm256_set1_epi64x((long long)now);
+    for (; i + 4 <= count; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i *)&times[i]);
+        int waiting = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_sub_epi64(nowv, t)));
+        if (waiting != 0xF) {
+            return i + __builtin_ctz(~waiting);
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i nowv = _mm_set1_epi64x((long long)now);
+    for (; i + 2 <= count; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i *)&times[i]);
+        int waiting = _mm_movemask_pd(_mm_castsi128_pd(_mm_sub_epi64(nowv, t)));
+        if (waiting != 0x3) {
+            return i + __builtin_ctz(~waiting);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint64x2_t nowv = vdupq_n_u64(now);
+    for (; i + 2 <= count; i += 2) {
+        uint64x2_t due = vcgezq_s64(vreinterpretq_s64_u64(vsubq_u64(nowv, vld1q_u64(&times[i]))));
+        if (vgetq_lane_u64(due, 0) | vgetq_lane_u64(due, 1)) {
+            break;
+        }
+    }
+#endif
+#endif
+
+    // The tail, or the vector NEON stopped at.
+    for (; i < count; i++) {
+        if (taskTimeReached(now, times[i])) {
+            return i;
+        }
+    }
+    return count;
+}
+
+#endif
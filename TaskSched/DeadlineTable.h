@@ -0,0 +1,117 @@
+/*
+ * TimedTask run times kept in a contiguous array, scanned with SIMD.
+ */
+
+/*
+ * Build with TASK_DEADLINE_TABLE.  Without a timer wheel, the scheduler
+ * finds due TimedTasks by calling canRun() on each in turn - a pointer to
+ * chase and a virtual call per task, whether due or not.  Given a
+ * DeadlineTable, it keeps each TimedTask's runTime, priority and pointer in
+ * three arrays in priority order, and finds the next due task by comparing
+ * the clock against a vector of run times at a time - 8 at once with AVX2,
+ * 4 with SSE2 or NEON, or one by one where there is no SIMD.  Only a task
+ * whose runTime has been reached is then polled and run, so with thousands
+ * of tasks a pass costs about a sequential read of the run times:
+ *
+ *     StaticDeadlineTable<1000> table;
+ *     TaskScheduler scheduler(tasks, NUM_TASKS(tasks));
+ *     scheduler.setDeadlineTable(&table);
+ *
+ * setRunTime() and incRunTime() keep a task's entry up to date.  As with a
+ * wheel, a TimedTask in a table is only polled once its runTime has been
+ * reached, so a canRun() override can add conditions but not run early.
+ * Tasks that don't fit in the table are polled as usual.
+ *
+ * The arrays are kept dense and in priority order, so the scan never skips
+ * holes - but adding or removing a task shifts every entry of lower
+ * priority, O(n) in the table's size.  Rescheduling is O(1); it's
+ * TaskScheduler::add() and remove(), and so suspend() and resume(), that
+ * pay, and a TaskGroup of k tabled tasks costs O(k * n) to suspend or
+ * resume.  The table suits task sets that are fixed once set up; for ones
+ * that come and go by the thousand, use a timer wheel.
+ */
+
+#ifndef DeadlineTable_h
+#define DeadlineTable_h
+
+#include "Task.h"
+
+#if defined(TASK_DEADLINE_TABLE)
+
+class DeadlineTable {
+
+public:
+    /*
+     * Create an empty table over arrays supplied by the caller.
+     * times, priorities, tasks - arrays of capacity entries each.
+     * capacity - most tasks the table can hold.
+     */
+    DeadlineTable(task_time_t *times, task_count_t *priorities, TimedTask **tasks,
+      task_count_t capacity);
+
+    /*
+     * Add a task, at its priority.
+     * return - false if the table is full.
+     */
+    bool add(TimedTask *task);
+
+    /*
+     * Take a task out of the table.
+     */
+    void remove(TimedTask *task);
+
+    /*
+     * Find the first entry, from a given one on, whose run time has been
+     * reached.
+     * now - current time, in clock ticks.
+     * from - the entry to start at.
+     * return - the entry, or getCount() if there is none.
+     */
+    task_count_t findDue(task_time_t now, task_count_t from);
+
+    /*
+     * Find the first entry at or below a given priority.
+     */
+    task_count_t seek(task_count_t priority);
+
+    /*
+     * Get an entry's task and priority.
+     */
+    inline TimedTask *getTask(task_count_t i) { return tasks[i]; }
+    inline task_count_t getPriority(task_count_t i) { return priorities[i]; }
+
+    inline task_count_t getCount() { return count; }
+
+    /*
+     * Get a task's entry.  The task must be in the table.
+     */
+    inline task_count_t indexOf(TimedTask *task) { return task->tableEntry - times; }
+
+private:
+    void move(task_count_t to, task_count_t from);
+
+    task_time_t *times;         // Run time of each entry.
+    task_count_t *priorities;   // Priority of each entry, ascending.
+    TimedTask **tasks;          // Task of each entry.
+    task_count_t capacity;      // Size of the arrays.
+    task_count_t count;         // Entries in use.
+};
+
+/*
+ * A DeadlineTable with room for N tasks.
+ */
+template <task_count_t N>
+class StaticDeadlineTable : public DeadlineTable {
+
+public:
+    inline StaticDeadlineTable() : DeadlineTable(timeArray, priorityArray, taskArray, N) {}
+
+private:
+    task_time_t timeArray[N] __attribute__((aligned(32)));
+    task_count_t priorityArray[N];
+    TimedTask *taskArray[N];
+};
+
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * A task that writes other tasks' debug messages out when nothing else is
+ * ready to run.
+ */
+
+#include "Debugger.h"
+
+#if !defined(ARDUINO)
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#if defined(ARDUINO)
+Debugger::Debugger(Print &_out) :
+  reported(0),
+  out(_out) {
+}
+#else
+Debugger::Debugger(int _fd) :
+  reported(0),
+  fd(_fd) {
+}
+#endif
+
+#if defined(TASK_LOG_TOKENS)
+
+/*
+ * Plain text goes out as a message with ID 0, so that it can share the
+ * stream with tokenized ones.
+ */
+void Debugger::debugWrite(const char *msg) {
+    TaskTokenBuf b(TaskToken(0));
+    b.putStr(msg);
+    writeBuf(b);
+}
+
+void Debugger::debugWrite(const char *msg, long value) {
+    char text[TASK_LOG_LINE];
+    LogRing::format(text, msg, value);
+    debugWrite(text);
+}
+
+#else
+
+void Debugger::debugWrite(const char *msg) {
+    log.write(msg);
+}
+
+void Debugger::debugWrite(const char *msg, long value) {
+    log.write(msg, value);
+}
+
+#endif
+
+/*
+ * Queue a finished message.
+ */
+void Debugger::writeBuf(TaskTokenBuf &b) {
+    uint8_t len = b.finish();
+    if (len) {
+        log.writeBytes(b.getData(), len);
+    } else {
+        log.drop();
+    }
+}
+
+bool Debugger::canRun(task_time_t now) {
+    return !log.isEmpty() || log.getDropped() != reported;
+}
+
+void Debugger::run(task_time_t now) {
+    uint32_t dropped = log.getDropped();
+    if (dropped != reported) {
+        TaskTokenBuf b(TASK_TOKEN("-- dropped: %u"));
+        b.putInt(dropped - reported);
+        reported = dropped;
+        writeOut(b.getData(), b.finish());
+        return;
+    }
+    uint8_t buf[TASK_LOG_LINE];
+    uint8_t len = log.readBytes(buf);
+    if (len) {
+        writeOut(buf, len);
+    }
+}
+
+#if defined(ARDUINO)
+
+void Debugger::writeOut(uint8_t *data, uint8_t len) {
+#if defined(TASK_LOG_TOKENS)
+    out.write(data, len);
+#else
+    out.println((const char *)data);
+#endif
+}
+
+#else
+
+void Debugger::writeOut(uint8_t *data, uint8_t len) {
+#if !defined(TASK_LOG_TOKENS)
+    // Text ends in a NUL - make it a newline.
+    data[len - 1] = '\n';
+#endif
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nowhere to report it - give the message up.
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * A task that writes other tasks' debug messages out when nothing else is
+ * ready to run.
+ */
+
+/*
+ * debugWrite() only copies the message into a LogRing and returns, so
+ * logging costs a task a few microseconds rather than a synchronous
+ * Serial.println(), and no heap String is needed to add a number:
+ *
+ *     ptrDebugger->debugWrite("Light Level: ", lightLevel);
+ *
+ * The Debugger itself is runnable while the ring holds a message, and
+ * writes out one message per run().  Make it the scheduler's idle task
+ * rather than add()ing it:
+ *
+ *     scheduler.setIdleTask(&debugger);
+ *
+ * and it only runs on passes where no other task can, draining the ring
+ * before the scheduler goes to its idle hook.  If messages were dropped
+ * because the ring was full, a line saying how many comes out before the
+ * next one.
+ *
+ * Messages can also be given as a TASK_TOKEN() format and its arguments:
+ *
+ *     ptrDebugger->debugWrite(TASK_TOKEN("Light Level: %d"), lightLevel);
+ *
+ * which with TASK_LOG_TOKENS defined sends a few bytes of binary instead of
+ * the text - plain messages are then sent as text frames in the same
+ * stream.  See TaskToken.h.
+ *
+ * On an Arduino messages go to a Print, e.g. Serial; host builds write
+ * them to a file descriptor.
+ */
+
+#ifndef Debugger_h
+#define Debugger_h
+
+#include "Task.h"
+#include "LogRing.h"
+#include "TaskToken.h"
+
+#if defined(ARDUINO)
+#if ARDUINO < 100
+#include <WProgram.h>
+#else
+#include <Arduino.h>
+#endif
+#endif
+
+class Debugger : public Task {
+
+public:
+#if defined(ARDUINO)
+    /*
+     * Create a debugger.
+     * out - where to write messages, e.g. Serial, already begun.
+     */
+    Debugger(Print &out);
+#else
+    /*
+     * Create a debugger.
+     * fd - file descriptor to write messages to, e.g. 2 for stderr.
+     */
+    Debugger(int fd);
+#endif
+
+    /*
+     * Queue a message.  Safe to call from an ISR, a signal handler or
+     * another thread.
+     */
+    void debugWrite(const char *msg);
+
+    /*
+     * Queue a message followed by a number in decimal.
+     */
+    void debugWrite(const char *msg, long value);
+
+    /*
+     * Queue a message made from a TASK_TOKEN() format and its arguments.
+     * A message too long to send is counted as dropped.
+     */
+    template <typename... Args>
+    inline void debugWrite(TaskToken token, Args... args) {
+        TaskTokenBuf b(token);
+        taskTokenPut(b, args...);
+        writeBuf(b);
+    }
+
+#if defined(ARDUINO)
+    /*
+     * Queue a copy of a String - prefer the forms above in time-critical
+     * code, as building the String is what costs.
+     */
+    inline void debugWrite(const String &msg) { debugWrite(msg.c_str()); }
+#endif
+
+    /*
+     * Can the task currently run?
+     * now - current time, in clock ticks.
+     */
+    virtual bool canRun(task_time_t now);
+
+    /*
+     * Write out the oldest message.
+     * now - current time, in clock ticks.
+     */
+    virtual void run(task_time_t now);
+
+    /*
+     * Get the number of messages dropped because the ring was full.
+     */
+    inline uint32_t getDropped() { return log.getDropped(); }
+
+private:
+    void writeBuf(TaskTokenBuf &b);
+    void writeOut(uint8_t *data, uint8_t len);
+
+    LogRing log;            // Messages waiting to be written.
+    uint32_t reported;      // Drops already reported.
+#if defined(ARDUINO)
+    Print &out;             // Where messages go.
+#else
+    int fd;                 // Where messages go.
+#endif
+};
+
+#endif
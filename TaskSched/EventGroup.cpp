@@ -0,0 +1,77 @@
+/*
+ * Event groups - one publish wakes every task waiting on its bits.
+ */
+
+#include "EventGroup.h"
+#include "TaskScheduler.h"
+#include "TaskAtomic.h"
+
+EventGroup::EventGroup() :
+  bits(0),
+  subscribers(0),
+  publishing(0) {
+}
+
+void EventGroup::publish(task_events_t b) {
+    // Counted while walking, so that ~EventTask() can wait for the walk to
+    // be done with it.
+    taskAtomicAdd(&publishing, (uint8_t)1);
+
+    // Bits first, so a subscriber run meanwhile already sees them.
+    task_events_t set = taskAtomicOr(&bits, b) | b;
+    for (EventTask *ep = taskAtomicLoad(&subscribers); ep; ep = taskAtomicLoad(&ep->nextSubscriber)) {
+        if (ep->matches(set)) {
+            ep->setRunnable();
+        }
+    }
+    taskAtomicAdd(&publishing, (uint8_t)-1);
+}
+
+void EventGroup::clear(task_events_t b) {
+    taskAtomicAnd(&bits, (task_events_t)~b);
+}
+
+task_events_t EventGroup::getBits() {
+    return taskAtomicLoad(&bits);
+}
+
+EventTask::EventTask(EventGroup &_group, task_events_t _mask, WaitMode _mode,
+  bool _clearOnRun) :
+  group(_group),
+  nextSubscriber(_group.subscribers),
+  mask(_mask),
+  mode(_mode),
+  clearOnRun(_clearOnRun) {
+    // Linked in one store, so a publish() under way sees the task or not.
+    taskAtomicStore(&group.subscribers, this);
+
+    // Bits published before the task subscribed still count.
+    if (matches(taskAtomicLoad(&group.bits))) {
+        setRunnable();
+    }
+}
+
+EventTask::~EventTask() {
+    EventTask *volatile *epp = &group.subscribers;
+    while (*epp != this) {
+        epp = &(*epp)->nextSubscriber;
+    }
+    taskAtomicStore(epp, (EventTask *)nextSubscriber);
+
+    // A publish() that had already reached the task may still be on it.
+    while (taskAtomicLoad(&group.publishing)) {
+    }
+}
+
+// Virtual.
+void EventTask::run(task_time_t now) {
+    resetRunnable();
+    task_events_t set = taskAtomicLoad(&group.bits) & mask;
+    if (!matches(set)) {
+        return;
+    }
+    if (clearOnRun) {
+        group.clear(mask);
+    }
+    handle(now, set);
+}
@@ -0,0 +1,138 @@
+/*
+ * Event groups - one publish wakes every task waiting on its bits.
+ */
+
+/*
+ * publish() sets bits, and every EventTask waiting on any or all of them
+ * becomes runnable:
+ *
+ *     #define EV_SLEEP 0x01
+ *     EventGroup appEvents;
+ *     class Display : public EventTask { ... EventTask(appEvents, EV_SLEEP) ... };
+ *
+ *     appEvents.publish(EV_SLEEP);
+ *
+ * Bits stay set until clear()ed, by the publisher or by a subscriber made
+ * with clearOnRun.
+ */
+
+#ifndef EventGroup_h
+#define EventGroup_h
+
+#include "Task.h"
+
+// A word of event bits.
+#if defined(__AVR__)
+typedef uint16_t task_events_t;
+#else
+typedef uint32_t task_events_t;
+#endif
+
+class EventTask;
+
+class EventGroup {
+
+public:
+    /*
+     * Create an event group with no bits set and no subscribers.
+     */
+    EventGroup();
+
+    /*
+     * Set event bits, making every task waiting on them runnable.  May be
+     * called from any context.  O(n) in the number of subscribers: each
+     * one woken has to be queued on its own for the scheduler to find it
+     * in priority order, so the cost is a mask test per subscriber and a
+     * ready queue push per match, without a lock.  An ISR that can't
+     * afford that can trigger a task that publishes instead.
+     */
+    void publish(task_events_t bits);
+
+    /*
+     * Clear event bits.  May be called from any context.
+     */
+    void clear(task_events_t bits);
+
+    /*
+     * Get the bits currently set.
+     */
+    task_events_t getBits();
+
+private:
+    friend class EventTask;
+
+    volatile task_events_t bits;    // Bits currently set.
+    EventTask *volatile subscribers;    // Subscribed tasks, newest first.
+    volatile uint8_t publishing;    // publish() calls walking the list.
+};
+
+/*
+ * A task that runs when bits in an EventGroup are published.  Subclasses
+ * implement handle() instead of run().
+ */
+class EventTask : public TriggeredTask {
+
+public:
+    enum WaitMode {
+        WAIT_ANY,       // Run when any bit in the mask is set.
+        WAIT_ALL        // Run when every bit in the mask is set.
+    };
+
+    /*
+     * Create a task subscribed to an event group, runnable at once if the
+     * group's bits already meet its condition.  Create and destroy
+     * subscribers from one thread at a time, not from an ISR; publish() may
+     * run meanwhile, and destroying a subscriber waits for any publish()
+     * still walking past it.
+     * group - the group.
+     * mask - the bits to wait on.
+     * mode - whether any or all of them are needed.
+     * clearOnRun - clear the mask's bits in the group on each run.
+     */
+    EventTask(EventGroup &group, task_events_t mask, WaitMode mode = WAIT_ANY,
+      bool clearOnRun = false);
+    ~EventTask();
+
+    /*
+     * Call handle() if the condition still holds - a subscriber with
+     * clearOnRun may have taken the bits since the publish.
+     * now - current time, in clock ticks.
+     */
+    virtual void run(task_time_t now);
+
+    /*
+     * Handle published events.
+     * now - current time, in clock ticks.
+     * bits - the bits of the mask that were set.
+     */
+    virtual void handle(task_time_t now, task_events_t bits) = 0;
+
+    /*
+     * Change what the task waits on.
+     */
+    inline void setMask(task_events_t _mask, WaitMode _mode = WAIT_ANY) {
+        mask = _mask;
+        mode = _mode;
+    }
+    inline task_events_t getMask() { return mask; }
+
+protected:
+    friend class EventGroup;
+
+    /*
+     * Do the group's bits meet the task's condition?
+     * bits - the group's bits.
+     */
+    inline bool matches(task_events_t bits) {
+        bits &= mask;
+        return mode == WAIT_ALL ? bits == mask : bits != 0;
+    }
+
+    EventGroup &group;      // Group subscribed to.
+    EventTask *volatile nextSubscriber; // Next in the group's subscriber list.
+    task_events_t mask;     // Bits waited on.
+    WaitMode mode;          // Any or all of them.
+    bool clearOnRun;        // Clear the mask's bits on each run.
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Lock-free ring of log messages waiting to be written out.
+ */
+
+#include "LogRing.h"
+#include "TaskAtomic.h"
+
+/*
+ * A slot's seq is its index while free on the first lap, index + 1 once
+ * written, and goes up by TASK_LOG_SLOTS each time it is read - so a writer
+ * holding position pos wants seq == pos, and the reader wants pos + 1.
+ * Differences are taken as signed so they survive the counters wrapping.
+ */
+LogRing::LogRing() :
+  head(0),
+  tail(0),
+  dropped(0) {
+    for (unsigned i = 0; i < TASK_LOG_SLOTS; i++) {
+        slots[i].seq = i;
+    }
+}
+
+/*
+ * Copy as much of a string as fits after the first i characters of a slot.
+ * return - the new length.
+ */
+static unsigned append(char *text, unsigned i, const char *s) {
+    while (*s && i < TASK_LOG_LINE - 1) {
+        text[i++] = *s++;
+    }
+    return i;
+}
+
+/*
+ * Claim the next free slot.
+ * pos - set to the position claimed.
+ * return - the slot, or NULL if the ring is full.
+ */
+LogRing::Slot *LogRing::claim(unsigned &pos) {
+    pos = taskAtomicLoad(&head);
+    for (;;) {
+        Slot *slot = &slots[pos & (TASK_LOG_SLOTS - 1)];
+        int diff = (int)(taskAtomicLoad(&slot->seq) - pos);
+        if (diff == 0) {
+            if (taskAtomicCompareExchange(&head, &pos, pos + 1)) {
+                return slot;
+            }
+        } else if (diff < 0) {
+            drop();
+            return 0;
+        } else {
+            // Another writer got there first.
+            pos = taskAtomicLoad(&head);
+        }
+    }
+}
+
+bool LogRing::write(const char *msg) {
+    unsigned pos;
+    Slot *slot = claim(pos);
+    if (!slot) {
+        return false;
+    }
+    unsigned len = append(slot->text, 0, msg);
+    slot->text[len] = '\0';
+    slot->len = len + 1;
+    taskAtomicStore(&slot->seq, pos + 1);
+    return true;
+}
+
+bool LogRing::write(const char *msg, long value) {
+    char text[TASK_LOG_LINE];
+    format(text, msg, value);
+    return write(text);
+}
+
+void LogRing::format(char *buf, const char *msg, long value) {
+    // Digits come out backwards, so build them at the end of a scratch
+    // buffer - big enough for a 64 bit long.
+    char digits[21];
+    unsigned d = sizeof(digits) - 1;
+    unsigned long v = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    digits[d] = '\0';
+    do {
+        digits[--d] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (value < 0) {
+        digits[--d] = '-';
+    }
+    buf[append(buf, append(buf, 0, msg), digits + d)] = '\0';
+}
+
+bool LogRing::writeBytes(const void *data, uint8_t len) {
+    unsigned pos;
+    Slot *slot = claim(pos);
+    if (!slot) {
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)data;
+    if (len > TASK_LOG_LINE) {
+        len = TASK_LOG_LINE;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        slot->text[i] = p[i];
+    }
+    slot->len = len;
+    taskAtomicStore(&slot->seq, pos + 1);
+    return true;
+}
+
+void LogRing::drop() {
+    taskAtomicAdd(&dropped, (uint32_t)1);
+}
+
+bool LogRing::read(char *buf) {
+    return readBytes(buf) != 0;
+}
+
+uint8_t LogRing::readBytes(void *buf) {
+    Slot *slot = &slots[tail & (TASK_LOG_SLOTS - 1)];
+    if ((int)(taskAtomicLoad(&slot->seq) - (tail + 1)) < 0) {
+        return 0;
+    }
+    uint8_t *p = (uint8_t *)buf;
+    uint8_t len = slot->len;
+    for (uint8_t i = 0; i < len; i++) {
+        p[i] = slot->text[i];
+    }
+    taskAtomicStore(&slot->seq, tail + TASK_LOG_SLOTS);
+    tail++;
+    return len;
+}
+
+bool LogRing::isEmpty() {
+    Slot *slot = &slots[tail & (TASK_LOG_SLOTS - 1)];
+    return (int)(taskAtomicLoad(&slot->seq) - (tail + 1)) < 0;
+}
+
+uint32_t LogRing::getDropped() {
+    return taskAtomicLoad(&dropped);
+}
@@ -0,0 +1,118 @@
+/*
+ * Lock-free ring of log messages waiting to be written out.
+ */
+
+/*
+ * A bounded multi-producer, single-consumer queue of fixed-size text slots
+ * (after Dmitry Vyukov's bounded queue).  write() claims a slot with one
+ * compare-and-swap, copies the message in and publishes it - it never
+ * blocks or allocates, so it is safe to call from tasks, ISRs, signal
+ * handlers and other threads.  When the ring is full the message is dropped
+ * and counted instead.  Messages longer than a slot are truncated.  Only one
+ * task, e.g. a Debugger, reads.  Slots can also hold binary messages, such
+ * as tokenized ones - see TaskToken.h.
+ */
+
+#ifndef LogRing_h
+#define LogRing_h
+
+#include <stdint.h>
+
+// Number of message slots - a power of 2.
+#ifndef TASK_LOG_SLOTS
+#define TASK_LOG_SLOTS 8
+#endif
+
+// Size of each slot, in bytes, including the terminating NUL.
+#ifndef TASK_LOG_LINE
+#define TASK_LOG_LINE 40
+#endif
+
+#if TASK_LOG_LINE > 255
+#error "LogRing: TASK_LOG_LINE must fit in a byte"
+#endif
+
+#if (TASK_LOG_SLOTS & (TASK_LOG_SLOTS - 1)) != 0
+#error "LogRing: TASK_LOG_SLOTS must be a power of 2"
+#endif
+
+class LogRing {
+
+public:
+    LogRing();
+
+    /*
+     * Queue a message.  May be called from any context.
+     * msg - the message, truncated to TASK_LOG_LINE - 1 characters.
+     * return - false if the ring was full and the message dropped.
+     */
+    bool write(const char *msg);
+
+    /*
+     * Queue a message followed by a number in decimal, e.g.
+     * write("Light Level: ", lightLevel), without building a String.
+     */
+    bool write(const char *msg, long value);
+
+    /*
+     * Format a message followed by a number, as write() would queue it.
+     * buf - TASK_LOG_LINE bytes.
+     */
+    static void format(char *buf, const char *msg, long value);
+
+    /*
+     * Queue a binary message.  May be called from any context.
+     * data - the message.
+     * len - its length, at most TASK_LOG_LINE bytes.
+     * return - false if the ring was full and the message dropped.
+     */
+    bool writeBytes(const void *data, uint8_t len);
+
+    /*
+     * Count a message that was dropped for some other reason, e.g. being
+     * too long to send.
+     */
+    void drop();
+
+    /*
+     * Take the oldest message off the ring.  Reader only.
+     * buf - TASK_LOG_LINE bytes to copy the message into.
+     * return - false if there is nothing to read.  A message whose writer
+     *   is still copying it in also reads as nothing, until it is finished.
+     */
+    bool read(char *buf);
+
+    /*
+     * Take the oldest message off the ring, as bytes.  Reader only.
+     * buf - TASK_LOG_LINE bytes to copy the message into.
+     * return - its length, which for text includes the NUL, or 0 if there
+     *   is nothing to read.
+     */
+    uint8_t readBytes(void *buf);
+
+    /*
+     * Is there a finished message to read?  Reader only.
+     */
+    bool isEmpty();
+
+    /*
+     * Get the number of messages dropped because the ring was full.
+     */
+    uint32_t getDropped();
+
+private:
+    struct Slot {
+        volatile unsigned seq;      // Which lap of the ring the slot is on.
+        uint8_t len;                // Bytes of text in use.
+        char text[TASK_LOG_LINE];   // The message.
+    };
+
+    Slot *claim(unsigned &pos);
+
+    Slot slots[TASK_LOG_SLOTS];     // The ring.
+    volatile unsigned head;         // Next slot to claim.
+    unsigned tail;                  // Next slot to read - reader only.
+    volatile uint32_t dropped;      // Messages lost to a full ring.
+};
+
+#endif
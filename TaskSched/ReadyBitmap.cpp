@@ -0,0 +1,95 @@
+/*
+ * Priority-indexed task lists, with a bitmap for picking the highest.
+ */
+
+#include "ReadyBitmap.h"
+
+#define TOP_BIT ((ready_word_t)1 << (TASK_READY_WORD_BITS - 1))
+
+static_assert(sizeof(ready_word_t) * 8 == TASK_READY_WORD_BITS,
+  "ReadyBitmap: TASK_READY_WORD_BITS must match __builtin_clz");
+
+ReadyBitmap::ReadyBitmap() :
+  summary(0),
+  cursor(0) {
+    for (unsigned l = 0; l < TASK_READY_LEVELS; l++) {
+        heads[l] = 0;
+    }
+    for (uint8_t w = 0; w < TASK_READY_WORDS; w++) {
+        words[w] = 0;
+    }
+}
+
+void ReadyBitmap::link(Task *task) {
+    task_count_t l = level(task);
+    Task *prev = 0;
+    Task *tp = heads[l];
+    if (l == TASK_READY_LEVELS - 1) {
+        // The shared last level is kept in priority order.
+        while (tp && tp->priority <= task->priority) {
+            prev = tp;
+            tp = tp->next;
+        }
+    }
+    task->prev = prev;
+    task->next = tp;
+    if (tp) {
+        tp->prev = task;
+    }
+    if (prev) {
+        prev->next = task;
+    } else {
+        heads[l] = task;
+    }
+
+    uint8_t w = l / TASK_READY_WORD_BITS;
+    words[w] |= TOP_BIT >> (l % TASK_READY_WORD_BITS);
+    summary |= TOP_BIT >> w;
+}
+
+void ReadyBitmap::unlink(Task *task) {
+    if (task == cursor) {
+        cursor = next(task);
+    }
+    task_count_t l = level(task);
+    if (task->prev) {
+        task->prev->next = task->next;
+    } else {
+        heads[l] = task->next;
+    }
+    if (task->next) {
+        task->next->prev = task->prev;
+    }
+    task->next = task->prev = 0;
+
+    if (!heads[l]) {
+        uint8_t w = l / TASK_READY_WORD_BITS;
+        if (!(words[w] &= ~(TOP_BIT >> (l % TASK_READY_WORD_BITS)))) {
+            summary &= ~(TOP_BIT >> w);
+        }
+    }
+}
+
+Task *ReadyBitmap::first(task_count_t from) {
+    if (from >= TASK_READY_LEVELS - 1) {
+        Task *tp = heads[TASK_READY_LEVELS - 1];
+        while (tp && tp->priority < from) {
+            tp = tp->next;
+        }
+        return tp;
+    }
+
+    // Mask off the levels above 'from' in its word, and failing that the
+    // words above it.
+    uint8_t w = from / TASK_READY_WORD_BITS;
+    ready_word_t bits = words[w] & (~(ready_word_t)0 >> (from % TASK_READY_WORD_BITS));
+    if (!bits) {
+        ready_word_t rest = w + 1 < TASK_READY_WORD_BITS ? summary & (~(ready_word_t)0 >> (w + 1)) : 0;
+        if (!rest) {
+            return 0;
+        }
+        w = __builtin_clz(rest);
+        bits = words[w];
+    }
+    return heads[w * TASK_READY_WORD_BITS + __builtin_clz(bits)];
+}
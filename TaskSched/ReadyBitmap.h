@@ -0,0 +1,106 @@
+/*
+ * Priority-indexed task lists, with a bitmap for picking the highest.
+ */
+
+/*
+ * A ReadyBitmap keeps one list of tasks per priority level, and a bit per
+ * level that is set while its list is non-empty.  Linking and unlinking a
+ * task are O(1), and finding the highest priority task - the first set bit
+ * - is a count-leading-zeros on a summary word, saying which words of the
+ * bitmap have bits set, and another on the word it picks.  So the cost of
+ * picking what to run depends on neither the number of tasks waiting nor
+ * the number of levels.
+ *
+ * The scheduler keeps its triggered tasks on one, and a timer wheel its due
+ * tasks.  Levels are tied to priorities 0 up to
+ * TASK_READY_LEVELS - 2; tasks of any lower priority share the last level,
+ * whose list is kept sorted and so costs O(n) to link into.  Within a level
+ * the order is unspecified.
+ */
+
+#ifndef ReadyBitmap_h
+#define ReadyBitmap_h
+
+#include "Task.h"
+
+// A word of the bitmap.
+typedef unsigned ready_word_t;
+
+#if defined(__AVR__)
+#define TASK_READY_WORD_BITS 16
+#else
+#define TASK_READY_WORD_BITS 32
+#endif
+
+// Number of priority levels, a multiple of the word size and at most its
+// square.  Each level costs a pointer.
+#ifndef TASK_READY_LEVELS
+#if defined(__AVR__)
+#define TASK_READY_LEVELS 16
+#else
+#define TASK_READY_LEVELS 256
+#endif
+#endif
+
+#define TASK_READY_WORDS (TASK_READY_LEVELS / TASK_READY_WORD_BITS)
+
+#if TASK_READY_LEVELS % TASK_READY_WORD_BITS || TASK_READY_WORDS > TASK_READY_WORD_BITS
+#error "ReadyBitmap: TASK_READY_LEVELS must be a multiple of the word size, and at most its square"
+#endif
+
+class ReadyBitmap {
+
+public:
+    ReadyBitmap();
+
+    /*
+     * Add a task, at its priority.  It must not already be on a list.
+     */
+    void link(Task *task);
+
+    /*
+     * Take a task off.
+     */
+    void unlink(Task *task);
+
+    /*
+     * Get the highest priority task at or below a given priority.
+     * from - the highest priority to consider.
+     * return - the task, or NULL if there are none.
+     */
+    Task *first(task_count_t from = 0);
+
+    /*
+     * Get the task after a given one, in priority order.
+     * return - the task, or NULL if there are no more.
+     */
+    inline Task *next(Task *task) {
+        if (task->next) {
+            return task->next;
+        }
+        task_count_t l = level(task);
+        return l + 1 < TASK_READY_LEVELS ? first(l + 1) : 0;
+    }
+
+    inline bool isEmpty() { return summary == 0; }
+
+    /*
+     * Set and get the cursor of a walk that runs tasks as it goes, and so
+     * may see them unlinked: unlinking the task the cursor is on moves the
+     * cursor to the next one.
+     */
+    inline void setCursor(Task *task) { cursor = task; }
+    inline Task *getCursor() { return cursor; }
+
+private:
+    static inline task_count_t level(Task *task) {
+        return task->priority < TASK_READY_LEVELS - 1 ? task->priority : TASK_READY_LEVELS - 1;
+    }
+
+    Task *heads[TASK_READY_LEVELS];             // Task list of each level.
+    ready_word_t words[TASK_READY_WORDS];       // Bit per level, MSB first.
+    ready_word_t summary;                       // Bit per non-empty word, MSB first.
+    Task *cursor;                               // A walk's next task, or NULL.
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Lock-free queue of triggered tasks waiting to be dispatched.
+ */
+
+#include "ReadyQueue.h"
+#include "TaskAtomic.h"
+
+ReadyQueue::ReadyQueue() :
+  head(&stub),
+  tail(&stub) {
+}
+
+void ReadyQueue::push(ReadyLink *link) {
+    taskAtomicStore(&link->readyNext, (ReadyLink *)0);
+    ReadyLink *prev = taskAtomicExchange(&head, link);
+    // Between the exchange and this store the queue is briefly cut in two;
+    // pop() sees the gap as empty rather than waiting for it to close.
+    taskAtomicStore(&prev->readyNext, link);
+}
+
+ReadyLink *ReadyQueue::pop() {
+    ReadyLink *t = tail;
+    ReadyLink *next = taskAtomicLoad(&t->readyNext);
+
+    // Step over the stub.
+    if (t == &stub) {
+        if (!next) {
+            return 0;
+        }
+        tail = next;
+        t = next;
+        next = taskAtomicLoad(&t->readyNext);
+    }
+
+    if (next) {
+        tail = next;
+        return t;
+    }
+
+    // t looks like the last entry - unless a push is part way through.
+    if (t != taskAtomicLoad(&head)) {
+        return 0;
+    }
+
+    // Put the stub back behind t so that t can be taken.
+    push(&stub);
+    next = taskAtomicLoad(&t->readyNext);
+    if (next) {
+        tail = next;
+        return t;
+    }
+    return 0;
+}
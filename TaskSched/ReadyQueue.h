@@ -0,0 +1,56 @@
+/*
+ * Lock-free queue of triggered tasks waiting to be dispatched.
+ */
+
+/*
+ * This is an intrusive multi-producer, single-consumer queue (after Dmitry
+ * Vyukov's design).  push() is a single atomic exchange plus a store, so it
+ * is wait-free and safe to call from ISRs, signal handlers and other
+ * threads.  Only the scheduler pops.
+ */
+
+#ifndef ReadyQueue_h
+#define ReadyQueue_h
+
+#include <stdint.h>
+
+/*
+ * The link a task needs to sit on a ReadyQueue.
+ */
+class ReadyLink {
+
+public:
+    inline ReadyLink() : readyNext(0) {}
+
+protected:
+    friend class ReadyQueue;
+
+    ReadyLink *volatile readyNext;
+};
+
+class ReadyQueue {
+
+public:
+    ReadyQueue();
+
+    /*
+     * Add an entry to the queue.  May be called from any context, but an
+     * entry must not be pushed again until it has been popped.
+     */
+    void push(ReadyLink *link);
+
+    /*
+     * Take the oldest entry off the queue.  Scheduler only.
+     * return - the entry, or NULL if the queue is empty.  May also return
+     *   NULL while a push() is part way through; the pusher wakes the
+     *   scheduler once it has finished, so nothing is lost.
+     */
+    ReadyLink *pop();
+
+private:
+    ReadyLink *volatile head;   // Most recently pushed entry.
+    ReadyLink *tail;            // Next entry to pop - consumer only.
+    ReadyLink stub;             // Keeps the queue from ever being empty.
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * A priority-based task scheduler whose task set is fixed at compile time.
+ */
+
+/*
+ * Given the concrete task types, the scheduler holds the tasks by value and
+ * calls canRun() and run() directly, so the compiler can inline them:
+ *
+ *     StaticTaskScheduler<SensorTask, LedTask> scheduler(sensor, led);
+ *     scheduler.get<1>().setRunnable();
+ *     scheduler.runTasks();
+ *
+ * Anything with "bool canRun(task_time_t now)" and "void run(task_time_t
+ * now)" will do as a task.  For Task subclasses the calls stay virtual
+ * unless the class or methods are final.
+ */
+
+#ifndef StaticTaskScheduler_h
+#define StaticTaskScheduler_h
+
+#include <stdint.h>
+#include "TaskClock.h"
+#include "Task.h"
+
+/*
+ * Non-virtual equivalent of TriggeredTask, for use with StaticTaskScheduler.
+ */
+class StaticTriggeredTask {
+
+public:
+    inline StaticTriggeredTask() : runFlag(false) {}
+
+    /*
+     * Can the task currently run?
+     * now - current time, in clock ticks.
+     */
+    inline bool canRun(task_time_t now) { return runFlag; }
+
+    /*
+     * Mark the task as runnable.
+     */
+    inline void setRunnable() { runFlag = true; }
+
+    /*
+     * Mark the task as non-runnable.
+     */
+    inline void resetRunnable() { runFlag = false; }
+
+protected:
+    volatile bool runFlag;  // True if the task is currently runnable.
+};
+
+/*
+ * Non-virtual equivalent of TimedTask, for use with StaticTaskScheduler.
+ */
+class StaticTimedTask {
+
+public:
+    /*
+     * Create a periodically executed task.
+     * when - the system clock tick when the task should run.
+     */
+    inline StaticTimedTask(task_time_t when) : runTime(when) {}
+
+    /*
+     * Can the task currently run?
+     * now - current system clock tick.
+     */
+    inline bool canRun(task_time_t now) { return taskTimeReached(now, runTime); }
+
+    /*
+     * Set the system clock tick when the task can next run.
+     * when - the system clock tick when the task should run.
+     */
+    inline void setRunTime(task_time_t when) { runTime = when; }
+
+    /*
+     * Increment the system clock tick when the task can next run.
+     * inc - system clock increment, in ticks.
+     */
+    inline void incRunTime(task_time_t inc) { runTime += inc; }
+
+    /*
+     * Get the system clock tick when the task can next run.
+     * return - system clock tick when the task is next due to run.
+     */
+    inline task_time_t getRunTime() { return runTime; }
+
+protected:
+    task_time_t runTime;    // The system clock tick when the task can next run.
+};
+
+/*
+ * The task set, as a chain of nested templates each holding one task by
+ * value, so the scheduler and its tasks are one object with no pointers
+ * between them.
+ */
+template <typename... Tasks>
+class StaticTaskList;
+
+template <unsigned I, typename... Tasks>
+struct StaticTaskAt;
+
+template <>
+class StaticTaskList<> {
+
+public:
+    inline bool dispatch(task_time_t now) { return false; }
+};
+
+template <typename T, typename... Rest>
+class StaticTaskList<T, Rest...> {
+
+public:
+    inline StaticTaskList() {}
+    inline StaticTaskList(const T &_task, const Rest &... _rest) :
+      task(_task),
+      rest(_rest...) {
+    }
+
+    /*
+     * Run this task if it can run, otherwise try the lower priority ones.
+     */
+    inline bool dispatch(task_time_t now) {
+        if (task.canRun(now)) {
+            task.run(now);
+            return true;
+        }
+        return rest.dispatch(now);
+    }
+
+private:
+    template <unsigned I, typename... Tasks>
+    friend struct StaticTaskAt;
+
+    T task;
+    StaticTaskList<Rest...> rest;
+};
+
+/*
+ * The type of, and a reference to, task I of a StaticTaskList.
+ */
+template <typename T, typename... Rest>
+struct StaticTaskAt<0, T, Rest...> {
+    typedef T type;
+    static inline T &get(StaticTaskList<T, Rest...> &list) { return list.task; }
+};
+
+template <unsigned I, typename T, typename... Rest>
+struct StaticTaskAt<I, T, Rest...> {
+    typedef typename StaticTaskAt<I - 1, Rest...>::type type;
+    static inline type &get(StaticTaskList<T, Rest...> &list) {
+        return StaticTaskAt<I - 1, Rest...>::get(list.rest);
+    }
+};
+
+template <typename... Tasks>
+class StaticTaskScheduler {
+
+public:
+    /*
+     * Create a new task scheduler, with each task default constructed.
+     * Tasks are scheduled in the order of the template arguments, the first
+     * being the highest priority.
+     */
+    inline StaticTaskScheduler() {}
+
+    /*
+     * Create a new task scheduler holding copies of the tasks given.
+     */
+    inline StaticTaskScheduler(const Tasks &... tasks) : list(tasks...) {}
+
+    /*
+     * Get the scheduler's copy of task I, e.g. for an ISR to setRunnable()
+     * or for tasks to be pointed at each other.
+     */
+    template <unsigned I>
+    inline typename StaticTaskAt<I, Tasks...>::type &get() {
+        return StaticTaskAt<I, Tasks...>::get(list);
+    }
+
+    /*
+     * Start the task scheduler running.  Never returns.
+     */
+    void runTasks() {
+        while (1) {
+            list.dispatch(taskClockNow());
+        }
+    }
+
+    /*
+     * Make a single pass, running the first task that can run.
+     * now - current time, in clock ticks.
+     * return - true if a task was run.
+     */
+    inline bool dispatch(task_time_t now) { return list.dispatch(now); }
+
+    /*
+     * Number of tasks, known at compile time.
+     */
+    static const task_count_t numTasks = sizeof...(Tasks);
+    static_assert(sizeof...(Tasks) < TASK_PRIORITY_END,
+      "too many tasks for task_count_t - see TASK_MANY_TASKS");
+
+private:
+    StaticTaskList<Tasks...> list;
+};
+
+#endif
@@ -4,13 +4,62 @@
  */
 
 #include "Task.h"
+#include "TimerWheel.h"
+#include "TaskScheduler.h"
+#include "TaskAtomic.h"
 
 // Virtual.
-bool TriggeredTask::canRun(uint32_t now) {
+bool TriggeredTask::canRun(task_time_t now) {
     return runFlag;
 }
 
+void TriggeredTask::trigger(TaskScheduler *sched) {
+    if (!taskAtomicExchange(&queued, true)) {
+        sched->enqueue(this);
+    }
+}
+
+// Virtual.
+bool TimedTask::canRun(task_time_t now) {
+    return taskTimeReached(now, runTime);
+}
+
+void TimedTask::reschedule() {
+    wheel->reschedule(this);
+}
+
 // Virtual.
-bool TimedTask::canRun(uint32_t now) {
-    return now >= runTime;
+void PeriodicTask::run(task_time_t now) {
+    tick(now);
+
+    // Look at the clock again, in case tick() itself overran.
+    now = taskClockNow();
+    task_time_t next = runTime + period;
+    if (period != 0 && taskTimeBefore(next, now)) {
+        // 'behind' periods are overdue, counting 'next' - one falling due
+        // just as tick() finishes is still on time.
+        task_time_t behind = (now - next - 1) / period + 1;
+        if (!catchingUp) {
+            overruns++;
+        }
+        switch (policy) {
+        case OVERRUN_SKIP:
+            next += behind * period;
+            skipped += behind;
+            break;
+        case OVERRUN_CATCH_UP:
+            if (behind > maxCatchUp) {
+                next += (behind - maxCatchUp) * period;
+                skipped += behind - maxCatchUp;
+            }
+            break;
+        case OVERRUN_REALIGN:
+            next = now + period;
+            skipped += behind;
+            break;
+        }
+    }
+    // Still behind after this run, so the next one is making up for it.
+    catchingUp = taskTimeBefore(next, now);
+    setRunTime(next);
 }
@@ -11,9 +11,28 @@
 #define Task_h
 
 #include <stdint.h>
+#include "TaskClock.h"
+#include "ReadyQueue.h"
+#include "TaskStats.h"
+#include "TaskTrace.h"
+#include "TaskAtomic.h"
 
-// Maximum time into the future - approximately 50 days.
-#define MAX_TIME UINT32_MAX
+// Maximum time into the future - approximately 24 days with the default
+// millisecond clock.  See TaskClock.h.
+#define MAX_TIME TASK_TIME_HORIZON
+
+// Task counts and priorities.  See TASK_MANY_TASKS in TaskConfig.h.
+#if defined(__AVR__) && !defined(TASK_MANY_TASKS)
+typedef uint8_t task_count_t;
+#else
+typedef uint32_t task_count_t;
+#endif
+
+// One past the lowest priority a task can be given.
+#define TASK_PRIORITY_END ((task_count_t)-1)
+
+class TimerWheel;
+class TaskScheduler;
 
 /*
  * A simple (abstract) task - base class for all other tasks.
@@ -27,35 +46,133 @@ class Task {
 */
 
 public:
+    inline Task() : next(0), prev(0), allNext(0), allPrev(0), priority(0) {
+#if defined(TASK_EDF)
+        deadline = 0;
+        absDeadline = 0;
+        deadlineMisses = 0;
+        released = false;
+#endif
+    }
+
     /*
      * Can the task currently run?
-     * now - current time, in milliseconds.
+     * now - current time, in clock ticks (milliseconds by default).
      */
-    virtual bool canRun(uint32_t now) = 0;		//<--ABSTRACT
+    virtual bool canRun(task_time_t now) = 0;		//<--ABSTRACT
 
     /*
      * Run the task,
-     * now - current time, in milliseconds.
+     * now - current time, in clock ticks (milliseconds by default).
+     */
+    virtual void run(task_time_t now) = 0;			//<--ABSTRACT
+
+    /*
+     * Return this task as a TimedTask, or NULL if it isn't one.  Lets the
+     * scheduler pick out timed tasks without needing RTTI.
+     */
+    virtual class TimedTask *asTimedTask() { return 0; }
+
+    /*
+     * Return this task as a TriggeredTask, or NULL if it isn't one.
+     */
+    virtual class TriggeredTask *asTriggeredTask() { return 0; }
+
+    /*
+     * Called by the scheduler once the task is add()ed, and with NULL as
+     * it is remove()d - so also by suspend() and resume().  For tasks that
+     * file timers of their own, to cancel and re-arm them.
+     * sched - the scheduler, or NULL.
      */
-    virtual void run(uint32_t now) = 0;			//<--ABSTRACT
+    virtual void registered(TaskScheduler *sched) {}
+
+    /*
+     * Get the task's priority.  0 is the highest, i.e. the first task in
+     * the scheduler's array.
+     */
+    inline task_count_t getPriority() { return priority; }
+
+#if defined(TASK_STATS)
+    /*
+     * Get the task's run-time statistics.
+     */
+    inline TaskStats &getStats() { return stats; }
+#endif
+
+#if defined(TASK_EDF)
+    /*
+     * Set the task's relative deadline, for DISPATCH_EDF.  Each time the
+     * task becomes runnable - for a TimedTask, at its runTime - it should
+     * finish run() within this many ticks.
+     * ticks - the deadline, or 0 for none; such tasks only run when no
+     *   task with a deadline can.
+     */
+    inline void setDeadline(task_time_t ticks) { deadline = ticks; }
+    inline task_time_t getDeadline() { return deadline; }
+
+    /*
+     * Get the number of runs that finished after their deadline.
+     */
+    inline uint32_t getDeadlineMisses() { return deadlineMisses; }
+#endif
+
+protected:
+    friend class TaskScheduler;
+    friend class ThreadedTaskScheduler;
+    friend class TimerWheel;
+    friend class ReadyBitmap;
+    friend class DeadlineTable;
+
+    Task *next;         // Scheduler list links - owned by the scheduler.
+    Task *prev;
+    Task *allNext;      // Links in the scheduler's list of all its tasks.
+    Task *allPrev;
+    task_count_t priority;  // 0 is highest - see TaskScheduler::add().
+#if defined(TASK_STATS)
+    TaskStats stats;    // Run-time statistics.
+#endif
+#if defined(TASK_EDF)
+    task_time_t deadline;       // Relative deadline, 0 for none.
+    task_time_t absDeadline;    // Deadline of the current release.
+    uint32_t deadlineMisses;    // Runs that finished late.
+    bool released;              // Runnable, with absDeadline set.
+#endif
 };
 
 /*
  * A task that is triggered by an external event.
  */
-class TriggeredTask : public Task {
+class TriggeredTask : public Task, public ReadyLink {
 
 public:
+    inline TriggeredTask() : runFlag(false), queued(false), scheduler(0) {}
+
     /*
      * Can the task currently run?
-     * now - current time, in milliseconds.
+     * now - current time, in clock ticks (milliseconds by default).
      */
-    virtual bool canRun(uint32_t now);
+    virtual bool canRun(task_time_t now);
+
+    virtual TriggeredTask *asTriggeredTask() { return this; }
 
     /*
-     * Mark the task as runnable.
+     * Mark the task as runnable.  Safe to call from an ISR, a signal
+     * handler or another thread.  Once the task is registered this also
+     * queues it for dispatch and wakes the scheduler from its idle hook.
+     * source - what triggered the task, e.g. an interrupt number, for the
+     *   dispatch trace - see TaskTrace.h.
      */
-    inline void setRunnable() { runFlag = true; }
+    inline void setRunnable(uint8_t source = 0) {
+#if defined(TASK_TRACE)
+        taskTrace.record(TRACE_TRIGGER, priority, source);
+#endif
+        runFlag = true;
+        // Read once, as remove() may clear it meanwhile.
+        TaskScheduler *sched = taskAtomicLoad(&scheduler);
+        if (sched) {
+            trigger(sched);
+        }
+    }
 
     /*
      * Mark the task as non-runnable.
@@ -63,7 +180,17 @@ public:
     inline void resetRunnable() { runFlag = false; }
 
 protected:
-    bool runFlag;   // True if the task is currently runnable.
+    friend class TaskScheduler;
+
+    /*
+     * Put the task on its scheduler's ready queue, unless it is already there.
+     * sched - the scheduler, as read by setRunnable().
+     */
+    void trigger(TaskScheduler *sched);
+
+    volatile bool runFlag;      // True if the task is currently runnable.
+    volatile bool queued;       // True while queued or waiting to run.
+    TaskScheduler *volatile scheduler;  // Scheduler registered with, if any.
 };
 
 /*
@@ -74,37 +201,160 @@ class TimedTask : public Task {
 public:
     /*
      * Create a periodically executed task.
-     * when - the system clock tick when the task should run, in milliseconds.
+     * when - the system clock tick when the task should run.
      */
-    inline TimedTask(uint32_t when) { runTime = when; }
+    inline TimedTask(task_time_t when) : runTime(when), wheel(0), wheelSlot(0) {
+#if defined(TASK_DEADLINE_TABLE)
+        tableEntry = 0;
+#endif
+    }
 
     /*
      * Can the task currently run?
-     * now - current system clock tick, in milliseconds.
+     * now - current system clock tick.
      */
-    virtual bool canRun(uint32_t now);
+    virtual bool canRun(task_time_t now);
+
+    virtual TimedTask *asTimedTask() { return this; }
 
     /*
      * Set the system clock tick when the task can next run.
-     * when - the system clock tick when the task should run, in milliseconds.
+     * when - the system clock tick when the task should run.
      */
-    inline void setRunTime(uint32_t when) { runTime = when; }
+    inline void setRunTime(task_time_t when) {
+        runTime = when;
+        if (wheel) {
+            reschedule();
+        }
+#if defined(TASK_DEADLINE_TABLE)
+        if (tableEntry) {
+            *tableEntry = runTime;
+        }
+#endif
+    }
 
     /*
      * Increment the system clock tick when the task can next run.
-     * inc - system clock increment, in milliseconds.
+     * inc - system clock increment, in ticks.
      */
-    inline void incRunTime(uint32_t inc) { runTime += inc; }
+    inline void incRunTime(task_time_t inc) {
+        runTime += inc;
+        if (wheel) {
+            reschedule();
+        }
+#if defined(TASK_DEADLINE_TABLE)
+        if (tableEntry) {
+            *tableEntry = runTime;
+        }
+#endif
+    }
 
     /*
      * Get the system clock tick when the task can next run.
      * return - system clock tick when the task is next due to run.
      */
-    inline uint32_t getRunTime() { return runTime; }
+    inline task_time_t getRunTime() { return runTime; }
+
+protected:
+    friend class TimerWheel;
+    friend class TaskScheduler;
+    friend class DeadlineTable;
+
+    /*
+     * Move the task to the timer wheel slot matching its new runTime.
+     */
+    void reschedule();
+
+    task_time_t runTime;    // The  system clock tick when the task can next run.
+    TimerWheel *wheel;      // Timer wheel holding this task, if any.
+    uint8_t wheelSlot;      // Slot of the wheel the task is linked into.
+#if defined(TASK_DEADLINE_TABLE)
+    task_time_t *tableEntry;    // Copy of runTime in a DeadlineTable, if any.
+#endif
+};
+
+/*
+ * A TimedTask that runs at a fixed period, with a choice of what to do when
+ * it falls behind - e.g. after a long run() or a sleep - rather than making
+ * up every missed period in a burst, as incRunTime(period) would.
+ * Subclasses implement tick() instead of run().
+ */
+class PeriodicTask : public TimedTask {
+
+public:
+    /*
+     * What to do once a period has been missed.
+     *   OVERRUN_SKIP - drop the missed periods and run at the next slot
+     *     on the original grid.
+     *   OVERRUN_CATCH_UP - make up missed periods back to back, but at most
+     *     maxCatchUp of them; any more are dropped.
+     *   OVERRUN_REALIGN - drop the missed periods and start a new grid
+     *     one period from now.
+     */
+    enum OverrunPolicy {
+        OVERRUN_SKIP,
+        OVERRUN_CATCH_UP,
+        OVERRUN_REALIGN
+    };
+
+    /*
+     * Create a periodic task.
+     * when - the system clock tick when the task should first run.
+     * period - ticks between runs.
+     * policy - what to do when periods are missed.
+     * maxCatchUp - for OVERRUN_CATCH_UP, most missed periods to make up.
+     */
+    inline PeriodicTask(task_time_t when, task_time_t _period,
+      OverrunPolicy _policy = OVERRUN_SKIP, uint8_t _maxCatchUp = 1) :
+      TimedTask(when),
+      period(_period),
+      policy(_policy),
+      maxCatchUp(_maxCatchUp),
+      overruns(0),
+      skipped(0),
+      catchingUp(false) {
+    }
+
+    /*
+     * Call tick(), then schedule the next run.
+     * now - current system clock tick.
+     */
+    virtual void run(task_time_t now);
+
+    /*
+     * Do the task's work for one period.
+     * now - current system clock tick.
+     */
+    virtual void tick(task_time_t now) = 0;
+
+    inline void setPeriod(task_time_t _period) { period = _period; }
+    inline task_time_t getPeriod() { return period; }
+
+    inline void setPolicy(OverrunPolicy _policy, uint8_t _maxCatchUp = 1) {
+        policy = _policy;
+        maxCatchUp = _maxCatchUp;
+    }
+
+    /*
+     * Get the number of times a run finished after its next slot.  Under
+     * OVERRUN_CATCH_UP the runs that make up for it aren't counted again.
+     */
+    inline uint32_t getOverruns() { return overruns; }
+
+    /*
+     * Get the number of periods dropped rather than run.
+     */
+    inline uint32_t getSkipped() { return skipped; }
+
+    inline void resetOverruns() { overruns = skipped = 0; }
 
 protected:
-    
-    uint32_t runTime;   // The  system clock tick when the task can next run.
+    task_time_t period;     // Ticks between runs.
+    OverrunPolicy policy;   // What to do when periods are missed.
+    uint8_t maxCatchUp;     // Most missed periods OVERRUN_CATCH_UP makes up.
+    uint32_t overruns;      // Runs that finished after the next slot.
+    uint32_t skipped;       // Periods dropped.
+    bool catchingUp;        // Making up missed periods.
 };
 
 #endif
@@ -0,0 +1,132 @@
+/*
+ * Minimal atomic operations for state shared with ISRs and other threads.
+ */
+
+/*
+ * On AVR each operation runs with interrupts disabled, which is all that is
+ * needed on a single core - it also keeps 16 bit pointer reads and writes
+ * from being torn by an ISR.  Elsewhere the GCC __atomic builtins are used.
+ *
+ * taskAtomicCompareExchange() stores v only if *p still equals *expected,
+ * and otherwise copies *p into *expected.  taskAtomicAdd() returns the sum,
+ * taskAtomicOr() and taskAtomicAnd() the old value.
+ */
+
+#ifndef TaskAtomic_h
+#define TaskAtomic_h
+
+#if defined(__AVR__)
+
+#include <util/atomic.h>
+
+template <typename T>
+inline T taskAtomicLoad(volatile T *p) {
+    T v;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        v = *p;
+    }
+    return v;
+}
+
+template <typename T>
+inline void taskAtomicStore(volatile T *p, T v) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *p = v;
+    }
+}
+
+template <typename T>
+inline T taskAtomicExchange(volatile T *p, T v) {
+    T old;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        old = *p;
+        *p = v;
+    }
+    return old;
+}
+
+template <typename T>
+inline bool taskAtomicCompareExchange(volatile T *p, T *expected, T v) {
+    bool ok;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ok = *p == *expected;
+        if (ok) {
+            *p = v;
+        } else {
+            *expected = *p;
+        }
+    }
+    return ok;
+}
+
+template <typename T>
+inline T taskAtomicAdd(volatile T *p, T v) {
+    T sum;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sum = *p + v;
+        *p = sum;
+    }
+    return sum;
+}
+
+template <typename T>
+inline T taskAtomicOr(volatile T *p, T v) {
+    T old;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        old = *p;
+        *p = old | v;
+    }
+    return old;
+}
+
+template <typename T>
+inline T taskAtomicAnd(volatile T *p, T v) {
+    T old;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        old = *p;
+        *p = old & v;
+    }
+    return old;
+}
+
+#else
+
+template <typename T>
+inline T taskAtomicLoad(volatile T *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+inline void taskAtomicStore(volatile T *p, T v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+template <typename T>
+inline T taskAtomicExchange(volatile T *p, T v) {
+    return __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL);
+}
+
+template <typename T>
+inline bool taskAtomicCompareExchange(volatile T *p, T *expected, T v) {
+    return __atomic_compare_exchange_n(p, expected, v, false,
+      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+inline T taskAtomicAdd(volatile T *p, T v) {
+    return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
+}
+
+template <typename T>
+inline T taskAtomicOr(volatile T *p, T v) {
+    return __atomic_fetch_or(p, v, __ATOMIC_ACQ_REL);
+}
+
+template <typename T>
+inline T taskAtomicAnd(volatile T *p, T v) {
+    return __atomic_fetch_and(p, v, __ATOMIC_ACQ_REL);
+}
+
+#endif
+
+#endif
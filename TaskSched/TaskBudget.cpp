@@ -0,0 +1,30 @@
+/*
+ * Tasks that do long jobs in bounded slices.
+ */
+
+#include "TaskBudget.h"
+
+BudgetedTask::Watchdog BudgetedTask::watchdog = 0;
+
+// Virtual.
+void BudgetedTask::run(task_time_t now) {
+    resetRunnable();
+    task_time_t start = taskClockNow();
+    TaskBudget budget(start, budgetTicks, budgetSteps);
+    if (step(now, budget) == MORE) {
+        // Still runnable, so picked again at this priority.
+        slices++;
+        setRunnable();
+    }
+
+    task_time_t elapsed = taskClockNow() - start;
+    if (elapsed > longest) {
+        longest = elapsed;
+    }
+    if (budgetTicks && elapsed > budgetTicks) {
+        overruns++;
+        if (watchdog) {
+            watchdog(*this, elapsed);
+        }
+    }
+}
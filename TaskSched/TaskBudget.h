@@ -0,0 +1,151 @@
+/*
+ * Tasks that do long jobs in bounded slices.
+ */
+
+/*
+ * Instead of looping in run() until the work is done, a BudgetedTask
+ * implements step(), which does what it can within a budget of clock ticks
+ * and/or iterations:
+ *
+ *     BudgetedTask::Result SerialReader::step(task_time_t now, TaskBudget &budget) {
+ *         while (Serial.available()) {
+ *             if (!budget.spend()) {
+ *                 return MORE;
+ *             }
+ *             ... handle one byte ...
+ *         }
+ *         return DONE;
+ *     }
+ *
+ * When step() returns MORE the task stays runnable, and is picked again at
+ * its own priority.
+ */
+
+#ifndef TaskBudget_h
+#define TaskBudget_h
+
+#include "Task.h"
+
+/*
+ * How much work one call of BudgetedTask::step() may do.
+ */
+class TaskBudget {
+
+public:
+    /*
+     * start - when the budget started, in clock ticks.
+     * ticks - clock ticks allowed, or 0 for no limit.
+     * steps - iterations allowed, or 0 for no limit.
+     */
+    inline TaskBudget(task_time_t _start, task_time_t _ticks, uint16_t _steps) :
+      start(_start),
+      ticks(_ticks),
+      steps(_steps),
+      used(0) {
+    }
+
+    /*
+     * Take one iteration's worth of the budget.
+     * return - false if the budget is spent, and the iteration should be
+     *   left for the next call.
+     */
+    inline bool spend() {
+        if (steps && used >= steps) {
+            return false;
+        }
+        if (ticks && (task_time_t)(taskClockNow() - start) >= ticks) {
+            return false;
+        }
+        used++;
+        return true;
+    }
+
+    /*
+     * Get the number of iterations taken.
+     */
+    inline uint16_t getUsed() { return used; }
+
+private:
+    task_time_t start;      // When the budget started.
+    task_time_t ticks;      // Clock ticks allowed, or 0.
+    uint16_t steps;         // Iterations allowed, or 0.
+    uint16_t used;          // Iterations taken.
+};
+
+class BudgetedTask : public TriggeredTask {
+
+public:
+    enum Result {
+        DONE,       // Nothing left to do until triggered again.
+        MORE        // Work left - run again.
+    };
+
+    /*
+     * Called with a task whose run() overran its time budget.
+     * elapsed - how long the run took, in clock ticks.
+     */
+    typedef void (*Watchdog)(BudgetedTask &task, task_time_t elapsed);
+
+    /*
+     * Create a budgeted task.
+     * ticks - clock ticks per run, or 0 for no limit.
+     * steps - iterations per run, or 0 for no limit.
+     */
+    inline BudgetedTask(task_time_t ticks, uint16_t steps = 0) :
+      budgetTicks(ticks),
+      budgetSteps(steps),
+      slices(0),
+      overruns(0),
+      longest(0) {
+    }
+
+    /*
+     * Call step() with a fresh budget, keeping the task runnable if it
+     * returns MORE.  A run longer than the time budget is counted as an
+     * overrun and reported to the watchdog - the budget can't force step()
+     * to stop.
+     * now - current time, in clock ticks.
+     */
+    virtual void run(task_time_t now);
+
+    /*
+     * Do as much work as the budget allows.
+     * now - current time, in clock ticks.
+     * budget - the budget, to spend() once per iteration.
+     * return - DONE if all the work is done, otherwise MORE.
+     */
+    virtual Result step(task_time_t now, TaskBudget &budget) = 0;
+
+    /*
+     * Change the budget given to each run.
+     */
+    inline void setBudget(task_time_t ticks, uint16_t steps = 0) {
+        budgetTicks = ticks;
+        budgetSteps = steps;
+    }
+
+    /*
+     * Get the number of runs that ended with work left, the number that
+     * overran the time budget, and the longest run, in clock ticks.
+     */
+    inline uint32_t getSlices() { return slices; }
+    inline uint32_t getOverruns() { return overruns; }
+    inline task_time_t getLongest() { return longest; }
+
+    /*
+     * Set the hook called for every overrun, by any BudgetedTask.
+     * hook - the hook, or NULL for none.
+     */
+    static inline void setWatchdog(Watchdog hook) { watchdog = hook; }
+
+private:
+    static Watchdog watchdog;   // Told of every overrun, if set.
+
+    task_time_t budgetTicks;    // Clock ticks per run, or 0.
+    uint16_t budgetSteps;       // Iterations per run, or 0.
+    uint32_t slices;            // Runs that left work.
+    uint32_t overruns;          // Runs longer than budgetTicks.
+    task_time_t longest;        // Longest run.
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * The time base used by tasks and the scheduler.
+ */
+
+#include "TaskClock.h"
+
+#if defined(TASK_CLOCK_VIRTUAL)
+
+volatile task_time_t taskVirtualNow = 0;
+
+#elif defined(TASK_TIME_64) && defined(ARDUINO) && !defined(TASK_CLOCK_STEADY) && !defined(TASK_CLOCK_TSC)
+
+#if defined(__AVR__)
+#include <util/atomic.h>
+#endif
+
+/*
+ * Extend the 32 bit Arduino counter to 64 bits by counting its wraps.  The
+ * count is shared with ISRs that read the clock, e.g. TaskTrace and
+ * PreemptiveTier, so is updated with interrupts off.
+ */
+task_time_t taskClockNow() {
+    static uint32_t last = 0;
+    static uint32_t high = 0;
+    task_time_t now;
+#if defined(__AVR__)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+    {
+#if defined(TASK_CLOCK_MICROS)
+        uint32_t low = micros();
+#else
+        uint32_t low = millis();
+#endif
+        if (low < last) {
+            high++;
+        }
+        last = low;
+        now = ((task_time_t)high << 32) | low;
+    }
+    return now;
+}
+
+#endif
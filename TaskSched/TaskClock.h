@@ -0,0 +1,132 @@
+/*
+ * The time base used by tasks and the scheduler.
+ */
+
+/*
+ * The clock is picked in TaskConfig.h.  Whatever the source, time is an
+ * unsigned tick count, task_time_t, that is allowed to wrap.  Deadlines
+ * must be compared with taskTimeReached()/taskTimeBefore(), which use
+ * serial number arithmetic and are correct across a wrap as long as the
+ * two times are less than TASK_TIME_HORIZON ticks apart.
+ */
+
+#ifndef TaskClock_h
+#define TaskClock_h
+
+#include <stdint.h>
+#include "TaskConfig.h"
+
+#if defined(TASK_CLOCK_STEADY) || defined(TASK_CLOCK_TSC)
+#undef TASK_TIME_64
+#define TASK_TIME_64 1
+#endif
+
+#if defined(TASK_TIME_64)
+typedef uint64_t task_time_t;
+typedef int64_t task_stime_t;
+#define TASK_TIME_BITS 64
+#else
+typedef uint32_t task_time_t;
+typedef int32_t task_stime_t;
+#define TASK_TIME_BITS 32
+#endif
+
+// Largest gap between two times that still compares correctly.
+#define TASK_TIME_HORIZON ((task_time_t)(((task_time_t)1 << (TASK_TIME_BITS - 1)) - 1))
+
+// Clock ticks per second.
+#if defined(TASK_CLOCK_MICROS) || defined(TASK_CLOCK_STEADY)
+#define TASK_TICKS_PER_SECOND 1000000UL
+#elif defined(TASK_CLOCK_TSC)
+#ifndef TASK_CLOCK_TSC_HZ
+#error "TASK_CLOCK_TSC needs TASK_CLOCK_TSC_HZ, the TSC frequency"
+#endif
+#define TASK_TICKS_PER_SECOND TASK_CLOCK_TSC_HZ
+#elif defined(TASK_CLOCK_VIRTUAL) && defined(TASK_CLOCK_VIRTUAL_HZ)
+#define TASK_TICKS_PER_SECOND TASK_CLOCK_VIRTUAL_HZ
+#else
+#define TASK_TICKS_PER_SECOND 1000UL
+#endif
+
+/*
+ * Has time 'when' been reached at time 'now'?
+ */
+inline bool taskTimeReached(task_time_t now, task_time_t when) {
+    return (task_stime_t)(now - when) >= 0;
+}
+
+/*
+ * Is time a strictly before time b?
+ */
+inline bool taskTimeBefore(task_time_t a, task_time_t b) {
+    return (task_stime_t)(a - b) < 0;
+}
+
+/*
+ * Read the clock.
+ * return - the current time, in ticks.
+ */
+#if defined(TASK_CLOCK_VIRTUAL)
+
+extern volatile task_time_t taskVirtualNow;
+
+inline task_time_t taskClockNow() { return taskVirtualNow; }
+
+/*
+ * Set the virtual clock.
+ * now - the new time, in ticks.
+ */
+inline void taskClockSet(task_time_t now) { taskVirtualNow = now; }
+
+#elif defined(TASK_CLOCK_STEADY)
+
+#include <chrono>
+
+inline task_time_t taskClockNow() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#elif defined(TASK_CLOCK_TSC)
+
+#include <x86intrin.h>
+
+inline task_time_t taskClockNow() { return __rdtsc(); }
+
+#elif !defined(ARDUINO)
+
+#include <time.h>
+
+/*
+ * Host build without an Arduino core - read CLOCK_MONOTONIC in place of
+ * millis() or micros(), so the same sketch code can run on Linux.
+ */
+inline task_time_t taskClockNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#if defined(TASK_CLOCK_MICROS)
+    return (task_time_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return (task_time_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif
+}
+
+#else
+
+#if ARDUINO < 100
+#include <WProgram.h>
+#else
+#include <Arduino.h>
+#endif
+
+#if defined(TASK_TIME_64)
+task_time_t taskClockNow();
+#elif defined(TASK_CLOCK_MICROS)
+inline task_time_t taskClockNow() { return micros(); }
+#else
+inline task_time_t taskClockNow() { return millis(); }
+#endif
+
+#endif
+
+#endif
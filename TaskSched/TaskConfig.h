@@ -0,0 +1,80 @@
+/*
+ * Compile-time configuration for the task scheduler.
+ */
+
+/*
+ * The Arduino IDE compiles these files separately from the sketch, so a
+ * #define in the .ino never reaches them - uncomment the lines below
+ * instead.  Host builds can also define them on the compiler command line.
+ */
+
+#ifndef TaskConfig_h
+#define TaskConfig_h
+
+// ***
+// *** Clock source.  Uncomment at most one - the default is millis().
+// *** Host builds without an Arduino core read CLOCK_MONOTONIC instead.
+// ***
+//#define TASK_CLOCK_MICROS 1      // micros(): 1us ticks, wraps every ~71 minutes.
+//#define TASK_CLOCK_STEADY 1      // std::chrono::steady_clock in us (host builds).
+//#define TASK_CLOCK_TSC 1         // x86 time stamp counter - set TASK_CLOCK_TSC_HZ.
+//#define TASK_CLOCK_VIRTUAL 1     // Virtual clock, moved on by taskClockSet() or TaskSimulator.
+
+// ***
+// *** Keep time in 64 bits so that it never wraps.  Always on for the
+// *** steady and TSC clocks.  With millis() or micros() the 32 bit counter
+// *** is extended in software, which needs the clock read at least once
+// *** per wrap - the scheduler does that on every pass.
+// ***
+//#define TASK_TIME_64 1
+
+// ***
+// *** Keep per-task run counts, canRun() polls, run() times and TimedTask
+// *** lateness, plus the scheduler's busy/idle time.  See TaskStats.h.
+// *** Costs RAM in every task and two clock reads per run(), and passes that
+// *** run a task poll the others again to count the ones held back.
+// ***
+//#define TASK_STATS 1
+
+// ***
+// *** Record task runs, triggers and idle spells into a ring for
+// *** taskTrace.dump() - see TaskTrace.h.  Costs 8 bytes per event held and
+// *** a clock read per event.
+// ***
+//#define TASK_TRACE 1
+
+// ***
+// *** Earliest deadline first dispatch - TaskScheduler::DISPATCH_EDF and
+// *** Task::setDeadline().  Costs RAM in every task.
+// ***
+//#define TASK_EDF 1
+
+// ***
+// *** Send Debugger messages written with TASK_TOKEN() as a compact binary
+// *** ID plus arguments instead of text - see TaskToken.h.  The host tool
+// *** in extras/tokens turns the stream back into text.
+// ***
+//#define TASK_LOG_TOKENS 1
+
+// ***
+// *** Let a scheduler without a timer wheel keep TimedTasks' run times in a
+// *** DeadlineTable, scanned with SIMD where the target has it - see
+// *** DeadlineTable.h.  For host builds with many tasks.  Costs a pointer in
+// *** every TimedTask.
+// ***
+//#define TASK_DEADLINE_TABLE 1
+
+// ***
+// *** PreemptiveTier - tasks run from a timer interrupt, preempting the
+// *** cooperative scheduler - see TaskPreempt.h.  Claims Timer2 on AVR.
+// ***
+//#define TASK_PREEMPT 1
+
+// ***
+// *** Largest number of tasks one scheduler can hold.  Kept to 255 on AVR
+// *** so task priorities fit in a byte, otherwise effectively unlimited.
+// *** Define TASK_MANY_TASKS to lift the AVR limit as well.
+// ***
+//#define TASK_MANY_TASKS 1
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * Tasks written as C++20 coroutines.
+ */
+
+#include "TaskCoroutine.h"
+
+#if defined(TASK_COROUTINES)
+
+#include "TaskScheduler.h"
+
+/*
+ * The frame pool.  Rounding each frame up to the strictest alignment keeps
+ * every one of them suitably aligned.
+ */
+struct CoroFrame {
+    uint8_t bytes[TASK_CORO_FRAME_SIZE];
+} __attribute__((aligned(__BIGGEST_ALIGNMENT__)));
+
+static CoroFrame framePool[TASK_CORO_FRAMES];
+static uint32_t framesUsed;     // Bitmap of allocated frames.
+
+void *taskCoroAlloc(size_t size) {
+    if (size > sizeof(CoroFrame)) {
+        return 0;
+    }
+    for (uint8_t f = 0; f < TASK_CORO_FRAMES; f++) {
+        if (!(framesUsed & (1UL << f))) {
+            framesUsed |= 1UL << f;
+            return &framePool[f];
+        }
+    }
+    return 0;
+}
+
+void taskCoroFree(void *frame) {
+    uint8_t f = static_cast<CoroFrame *>(frame) - framePool;
+    framesUsed &= ~(1UL << f);
+}
+
+void CoroutineAlarm::set(TaskScheduler *s, task_time_t when) {
+    if (sched) {
+        setRunTime(when);
+        return;
+    }
+    priority = owner->getPriority();
+    runTime = when;
+    sched = s;
+    sched->schedule(this);
+}
+
+void CoroutineAlarm::cancel() {
+    if (sched) {
+        sched->unschedule(this);
+        sched = 0;
+    }
+}
+
+// Virtual.
+void CoroutineAlarm::run(task_time_t now) {
+    owner->resume(now);
+}
+
+CoroutineTask::CoroutineTask() :
+  state(CORO_START),
+  resumedAt(0),
+  wakeAt(0),
+  alarm(this) {
+    // Runnable from the start, so that body() gets entered.
+    runFlag = true;
+}
+
+CoroutineTask::~CoroutineTask() {
+    alarm.cancel();
+    if (handle) {
+        handle.destroy();
+    }
+}
+
+// Virtual.
+void CoroutineTask::registered(TaskScheduler *sched) {
+    if (!sched) {
+        alarm.cancel();
+    } else if (state == CORO_SLEEPING) {
+        alarm.set(sched, wakeAt);
+    }
+}
+
+// Virtual.
+bool CoroutineTask::canRun(task_time_t now) {
+    switch (state) {
+    case CORO_START:
+    case CORO_WAITING:
+        return runFlag;
+    case CORO_SLEEPING:
+        return taskTimeReached(now, wakeAt);
+    default:
+        return false;
+    }
+}
+
+// Virtual.
+void CoroutineTask::run(task_time_t now) {
+    if (state == CORO_START) {
+        resetRunnable();
+        handle = body().release();
+        if (!handle) {
+            state = CORO_FAILED;
+            return;
+        }
+    }
+    resume(now);
+}
+
+/*
+ * Run body() on to its next suspension point, tidying up if it returns.
+ */
+void CoroutineTask::resume(task_time_t now) {
+    alarm.cancel();
+    resumedAt = now;
+    state = CORO_RUNNING;
+    handle.resume();
+    if (handle.done()) {
+        handle.destroy();
+        handle = 0;
+        state = CORO_DONE;
+        resetRunnable();
+    }
+}
+
+/*
+ * Called as body() suspends in sleepFor() or sleepUntil().
+ */
+void CoroutineTask::sleep() {
+    state = CORO_SLEEPING;
+    if (scheduler) {
+        alarm.set(scheduler, wakeAt);
+    }
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Tasks written as C++20 coroutines.
+ */
+
+/*
+ * A CoroutineTask's body() is straight-line code that suspends itself:
+ *
+ *     class Flasher : public CoroutineTask {
+ *         TaskCoroutine body() {
+ *             while (true) {
+ *                 digitalWrite(pin, HIGH);
+ *                 co_await sleepFor(rate);
+ *                 digitalWrite(pin, LOW);
+ *                 co_await sleepFor(rate);
+ *             }
+ *         }
+ *     };
+ *
+ * Frames come from a fixed pool of TASK_CORO_FRAMES blocks, never the heap.
+ * Needs C++20 and a <coroutine> header; without them none of this is
+ * compiled.
+ */
+
+#ifndef TaskCoroutine_h
+#define TaskCoroutine_h
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define TASK_COROUTINES 1
+#endif
+#endif
+
+#if defined(TASK_COROUTINES)
+
+#include <stddef.h>
+#include <coroutine>
+#include "Task.h"
+
+// Number of coroutine frames in the pool (at most 32).
+#ifndef TASK_CORO_FRAMES
+#define TASK_CORO_FRAMES 4
+#endif
+
+// Size of each frame, in bytes.
+#ifndef TASK_CORO_FRAME_SIZE
+#define TASK_CORO_FRAME_SIZE 128
+#endif
+
+#if TASK_CORO_FRAMES > 32
+#error "TaskCoroutine: too many frames"
+#endif
+
+/*
+ * Take a frame from the pool.
+ * size - bytes needed.
+ * return - the frame, or NULL if it is too big or the pool is empty.
+ */
+void *taskCoroAlloc(size_t size);
+
+/*
+ * Return a frame to the pool.
+ */
+void taskCoroFree(void *frame);
+
+/*
+ * The return type of CoroutineTask::body() - owns the coroutine frame until
+ * the task takes it over.
+ */
+class TaskCoroutine {
+
+public:
+    struct promise_type {
+        inline TaskCoroutine get_return_object() {
+            return TaskCoroutine(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        static inline TaskCoroutine get_return_object_on_allocation_failure() {
+            return TaskCoroutine();
+        }
+        inline std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+        inline std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+        inline void return_void() {}
+        inline void unhandled_exception() {}
+        static inline void *operator new(size_t size) noexcept { return taskCoroAlloc(size); }
+        static inline void operator delete(void *frame) { taskCoroFree(frame); }
+    };
+
+    inline TaskCoroutine() : handle(0) {}
+    inline TaskCoroutine(TaskCoroutine &&other) : handle(other.handle) { other.handle = 0; }
+    inline ~TaskCoroutine() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    /*
+     * Give up ownership of the frame.
+     */
+    inline std::coroutine_handle<> release() {
+        std::coroutine_handle<> h = handle;
+        handle = 0;
+        return h;
+    }
+
+private:
+    inline TaskCoroutine(std::coroutine_handle<promise_type> h) : handle(h) {}
+    TaskCoroutine(const TaskCoroutine &);
+    TaskCoroutine &operator=(const TaskCoroutine &);
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+class CoroutineTask;
+
+/*
+ * Resumes a sleeping CoroutineTask.
+ */
+class CoroutineAlarm : public TimedTask {
+
+public:
+    inline CoroutineAlarm(CoroutineTask *_owner) : TimedTask(0), owner(_owner), sched(0) {}
+
+    virtual void run(task_time_t now);
+
+    /*
+     * File the alarm with a scheduler, at its owner's priority, or move it
+     * if it is already filed.
+     */
+    void set(TaskScheduler *sched, task_time_t when);
+
+    /*
+     * Take the alarm off its scheduler, if it is filed.
+     */
+    void cancel();
+
+private:
+    CoroutineTask *owner;   // Task to resume.
+    TaskScheduler *sched;   // Scheduler filed with, if any.
+};
+
+class CoroutineTask : public TriggeredTask {
+
+public:
+    enum State {
+        CORO_START,         // body() not yet entered.
+        CORO_SLEEPING,      // In sleepFor() or sleepUntil().
+        CORO_WAITING,       // In triggered().
+        CORO_RUNNING,       // Resumed and not yet suspended.
+        CORO_DONE,          // body() has returned.
+        CORO_FAILED         // No frame for body().
+    };
+
+    CoroutineTask();
+    ~CoroutineTask();
+
+    /*
+     * Can the task currently run?
+     * now - current time, in clock ticks.
+     */
+    virtual bool canRun(task_time_t now);
+
+    /*
+     * Cancel the alarm of a sleeping coroutine as it is removed or
+     * suspended, and re-arm it when added back.
+     */
+    virtual void registered(TaskScheduler *sched);
+
+    /*
+     * Resume the coroutine, entering body() the first time.
+     * now - current time, in clock ticks.
+     */
+    virtual void run(task_time_t now);
+
+    inline State getState() { return state; }
+
+protected:
+    friend class CoroutineAlarm;
+
+    struct SleepAwaiter {
+        CoroutineTask *task;
+        task_time_t when;
+        inline bool await_ready() { return taskTimeReached(task->resumedAt, when); }
+        inline void await_suspend(std::coroutine_handle<>) { task->sleep(); }
+        inline void await_resume() {}
+    };
+
+    struct TriggerAwaiter {
+        CoroutineTask *task;
+        inline bool await_ready() { return task->runFlag; }
+        inline void await_suspend(std::coroutine_handle<>) { task->state = CORO_WAITING; }
+        inline void await_resume() { task->resetRunnable(); }
+    };
+
+    /*
+     * The task's logic, as a coroutine.
+     */
+    virtual TaskCoroutine body() = 0;
+
+    /*
+     * co_await sleepFor(ticks) - suspend until ticks after the task was
+     * last resumed.
+     */
+    inline SleepAwaiter sleepFor(task_time_t ticks) {
+        return sleepUntil(resumedAt + ticks);
+    }
+
+    /*
+     * co_await sleepUntil(when) - suspend until a time, which allows
+     * drift-free periods, e.g. sleepUntil(getWakeTime() + rate).
+     */
+    inline SleepAwaiter sleepUntil(task_time_t when) {
+        wakeAt = when;
+        SleepAwaiter a = { this, when };
+        return a;
+    }
+
+    /*
+     * co_await triggered() - suspend until setRunnable(), unless it has
+     * already been called.
+     */
+    inline TriggerAwaiter triggered() {
+        TriggerAwaiter a = { this };
+        return a;
+    }
+
+    /*
+     * Get the time passed to run() when the task was last resumed.
+     */
+    inline task_time_t getTime() { return resumedAt; }
+
+    /*
+     * Get the time the task last slept until.
+     */
+    inline task_time_t getWakeTime() { return wakeAt; }
+
+private:
+    void sleep();
+    void resume(task_time_t now);
+
+    std::coroutine_handle<> handle;     // The suspended body(), if any.
+    volatile State state;               // What the coroutine is waiting for.
+    task_time_t resumedAt;              // now, as of the last resume.
+    task_time_t wakeAt;                 // When a sleep ends.
+    CoroutineAlarm alarm;               // Wakes the task from a sleep.
+};
+
+#endif
+
+#endif
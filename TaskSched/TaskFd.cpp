@@ -0,0 +1,96 @@
+/*
+ * Tasks run when a file descriptor is ready, for Linux builds.
+ */
+
+#include "TaskFd.h"
+
+#if defined(__linux__)
+
+#include <unistd.h>
+#include "TaskAtomic.h"
+
+// Most ready descriptors taken per epoll_wait().
+#define EPOLL_BATCH 16
+
+// Virtual.
+void FdTask::run(task_time_t now) {
+    resetRunnable();
+    handle(now, taskAtomicExchange(&ready, (uint32_t)0));
+}
+
+bool FdTask::setEvents(uint32_t _events) {
+    events = _events;
+    if (!poller) {
+        return true;
+    }
+    struct epoll_event ev;
+    ev.events = events | EPOLLRDHUP;
+    ev.data.ptr = this;
+    return epoll_ctl(poller->epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+LinuxEpollIdle::LinuxEpollIdle() :
+  epfd(epoll_create1(EPOLL_CLOEXEC)) {
+    // The wake-up eventfd, with no task.
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = 0;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, getFd(), &ev);
+}
+
+LinuxEpollIdle::~LinuxEpollIdle() {
+    if (epfd >= 0) {
+        close(epfd);
+    }
+}
+
+bool LinuxEpollIdle::add(FdTask &task) {
+    struct epoll_event ev;
+    ev.events = task.events | EPOLLRDHUP;
+    ev.data.ptr = &task;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, task.fd, &ev) != 0) {
+        return false;
+    }
+    task.poller = this;
+    return true;
+}
+
+void LinuxEpollIdle::remove(FdTask &task) {
+    if (task.poller == this) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, task.fd, 0);
+        task.poller = 0;
+    }
+}
+
+void LinuxEpollIdle::idle(task_time_t now, task_time_t until) {
+    // Wait on the epoll descriptor itself, which ppoll() can do to the
+    // clock tick, rather than epoll_wait() to the millisecond.
+    if (taskPollUntil(epfd, now, until)) {
+        collect(0);
+    }
+}
+
+/*
+ * Trigger the tasks of the ready descriptors, and drain any wake-ups.
+ */
+int LinuxEpollIdle::collect(int timeout) {
+    struct epoll_event evs[EPOLL_BATCH];
+    int n = epoll_wait(epfd, evs, EPOLL_BATCH, timeout);
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        FdTask *task = static_cast<FdTask *>(evs[i].data.ptr);
+        if (task) {
+            taskAtomicOr(&task->ready, (uint32_t)evs[i].events);
+            task->setRunnable();
+            count++;
+        } else {
+            // wake() - several collapse into one.
+            uint64_t wakes;
+            ssize_t got = read(getFd(), &wakes, sizeof(wakes));
+            (void)got;
+        }
+    }
+    return count;
+}
+
+#endif
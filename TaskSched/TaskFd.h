@@ -0,0 +1,132 @@
+/*
+ * Tasks run when a file descriptor is ready, for Linux builds.
+ */
+
+/*
+ * An FdTask is triggered by a LinuxEpollIdle, the scheduler's idle hook,
+ * when its descriptor is ready, so I/O and timed tasks share one thread
+ * that sleeps whenever there is nothing to do:
+ *
+ *     LinuxEpollIdle epoll;
+ *     scheduler.setIdleHook(&epoll);
+ *     epoll.add(gateway);         // class Gateway : public FdTask
+ *     scheduler.runTasks();
+ *
+ *     void Gateway::handle(task_time_t now, uint32_t events) {
+ *         if (events & (FD_HANGUP | FD_ERROR)) { ... close, epoll.remove() ... }
+ *         if (events & FD_READ) { ... read() what is there ... }
+ *     }
+ *
+ * Readiness is level triggered and only looked at when the scheduler goes
+ * idle - see check().
+ */
+
+#ifndef TaskFd_h
+#define TaskFd_h
+
+#if defined(__linux__)
+
+#include <sys/epoll.h>
+#include "Task.h"
+#include "TaskIdle.h"
+
+class LinuxEpollIdle;
+
+class FdTask : public TriggeredTask {
+
+public:
+    // Readiness events.
+    enum {
+        FD_READ = EPOLLIN,
+        FD_WRITE = EPOLLOUT,
+        FD_HANGUP = EPOLLHUP | EPOLLRDHUP,
+        FD_ERROR = EPOLLERR
+    };
+
+    /*
+     * Create a task for a descriptor.
+     * fd - the descriptor.
+     * events - FD_READ and/or FD_WRITE, the events to watch for.
+     */
+    inline FdTask(int _fd, uint32_t _events = FD_READ) :
+      fd(_fd),
+      events(_events),
+      ready(0),
+      poller(0) {
+    }
+
+    /*
+     * Collect the events seen and call handle().
+     * now - current time, in clock ticks.
+     */
+    virtual void run(task_time_t now);
+
+    /*
+     * Handle readiness.  A descriptor still ready afterwards triggers the
+     * task again.  Hang-ups and errors are always reported, and the task
+     * must then stop watching the descriptor.
+     * now - current time, in clock ticks.
+     * events - the events seen since the last run.
+     */
+    virtual void handle(task_time_t now, uint32_t events) = 0;
+
+    /*
+     * Change the events watched for.  Only watch FD_WRITE while there is
+     * something to write, or the task runs on every idle.
+     * return - false if the poller refused the change.
+     */
+    bool setEvents(uint32_t events);
+
+    inline uint32_t getEvents() { return events; }
+    inline int getFd() { return fd; }
+
+private:
+    friend class LinuxEpollIdle;
+
+    int fd;                     // The descriptor.
+    uint32_t events;            // Events watched for.
+    volatile uint32_t ready;    // Events seen since the last run.
+    LinuxEpollIdle *poller;     // Poller watching fd, if any.
+};
+
+/*
+ * An idle hook that blocks in epoll on FdTasks' descriptors as well as
+ * waiting for the next TimedTask and for wake().
+ */
+class LinuxEpollIdle : public LinuxEventIdle {
+
+public:
+    LinuxEpollIdle();
+    ~LinuxEpollIdle();
+
+    /*
+     * Watch an FdTask's descriptor.
+     * return - false if epoll refused it, e.g. for a regular file.
+     */
+    bool add(FdTask &task);
+
+    /*
+     * Stop watching an FdTask's descriptor.  Do this before closing it.
+     */
+    void remove(FdTask &task);
+
+    virtual void idle(task_time_t now, task_time_t until);
+
+    /*
+     * Trigger the FdTasks whose descriptors are ready, without blocking,
+     * e.g. from a task when the scheduler is too busy to go idle.
+     * return - the number of descriptors ready.
+     */
+    inline int check() { return collect(0); }
+
+private:
+    friend class FdTask;
+
+    int collect(int timeout);
+
+    int epfd;       // The epoll instance.
+};
+
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Named groups of tasks, suspended and resumed together.
+ */
+
+#include "TaskGroup.h"
+
+TaskGroup::TaskGroup(TaskScheduler &_scheduler, Task **_tasks, task_count_t _numTasks,
+  const char *_name) :
+  scheduler(_scheduler),
+  tasks(_tasks),
+  numTasks(_numTasks),
+  name(_name),
+  suspendedAt(0),
+  suspended(false) {
+}
+
+void TaskGroup::suspend() {
+    if (suspended) {
+        return;
+    }
+    suspendedAt = taskClockNow();
+    for (task_count_t t = 0; t < numTasks; t++) {
+        scheduler.suspend(*tasks[t]);
+    }
+    suspended = true;
+}
+
+void TaskGroup::resume(ResumeMode mode) {
+    if (!suspended) {
+        return;
+    }
+    task_time_t now = taskClockNow();
+    for (task_count_t t = 0; t < numTasks; t++) {
+        // Off the wheel and any table while suspended, so the run time can
+        // be changed before the task goes back.
+        Task *tp = tasks[t];
+        TimedTask *ttp = tp->asTimedTask();
+        TriggeredTask *gtp = tp->asTriggeredTask();
+        if (mode == RESUME_FROZEN && ttp) {
+            ttp->incRunTime(now - suspendedAt);
+        } else if (mode == RESUME_RESTART) {
+            if (ttp) {
+                ttp->setRunTime(now);
+            } else if (gtp) {
+                gtp->resetRunnable();
+            }
+        }
+        scheduler.resume(*tp);
+    }
+    suspended = false;
+}
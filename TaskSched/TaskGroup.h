@@ -0,0 +1,76 @@
+/*
+ * Named groups of tasks, suspended and resumed together.
+ */
+
+/*
+ *     Task *ledTasks[] = { &statusLed, &heartbeat };
+ *     TaskGroup leds(scheduler, ledTasks, NUM_TASKS(ledTasks), "leds");
+ *
+ *     leds.suspend();
+ *     ... sleep ...
+ *     leds.resume(TaskGroup::RESUME_FROZEN);
+ *
+ * A suspended task is off the scheduler's lists, wheel and table, so costs
+ * nothing per pass.  Call suspend() and resume() from a task or between
+ * passes, not from an ISR.
+ */
+
+#ifndef TaskGroup_h
+#define TaskGroup_h
+
+#include "TaskScheduler.h"
+
+class TaskGroup {
+
+public:
+    // What happens to the TimedTasks' run times on resume().
+    enum ResumeMode {
+        RESUME_FROZEN,      // Shifted by the time suspended.
+        RESUME_KEEP_PHASE,  // Left as they were, so overdue ones run at once.
+        RESUME_RESTART      // Due at once, and triggers are dropped.
+    };
+
+    /*
+     * Create a running group.  Its tasks must stay registered, and not be
+     * suspended on their own.
+     * scheduler - the scheduler the tasks are registered with.
+     * tasks - array of the group's task pointers.
+     * numTasks - number of tasks in the array.
+     * name - name for diagnostics, or NULL.
+     */
+    TaskGroup(TaskScheduler &scheduler, Task **tasks, task_count_t numTasks,
+      const char *name = 0);
+
+    /*
+     * Take every task in the group out of scheduling.  Does nothing if the
+     * group is already suspended.
+     */
+    void suspend();
+
+    /*
+     * Put every task in the group back, at its old priority.  A TriggeredTask
+     * triggered meanwhile runs.  Does nothing unless the group is suspended.
+     * mode - what to do with the TimedTasks' run times.  With
+     *   RESUME_KEEP_PHASE, keep the suspension shorter than
+     *   TASK_TIME_HORIZON, or overdue tasks look far off.
+     */
+    void resume(ResumeMode mode = RESUME_FROZEN);
+
+    inline bool isSuspended() { return suspended; }
+    inline const char *getName() { return name; }
+
+    /*
+     * Get when the group was last suspended, in clock ticks.
+     */
+    inline task_time_t getSuspendedAt() { return suspendedAt; }
+
+private:
+    TaskScheduler &scheduler;   // Scheduler the tasks belong to.
+    Task **tasks;               // The group's tasks.
+    task_count_t numTasks;      // Number of tasks.
+    const char *name;           // Name, or NULL.
+    task_time_t suspendedAt;    // When last suspended.
+    bool suspended;             // True while suspended.
+};
+
+#endif
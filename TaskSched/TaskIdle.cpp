@@ -0,0 +1,128 @@
+/*
+ * Idle hooks - what the scheduler does when no task can run.
+ */
+
+#include "TaskIdle.h"
+
+#if defined(__AVR__)
+
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+void AvrSleepIdle::idle(task_time_t now, task_time_t until) {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (taskTimeBefore(taskClockNow(), until)) {
+        // Check and sleep with interrupts off, so a wake() can't slip in
+        // between the two - sei() takes effect after the sleep instruction.
+        cli();
+        if (woken) {
+            sei();
+            break;
+        }
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    woken = false;
+}
+
+void AvrSleepIdle::wake() {
+    woken = true;
+}
+
+#endif
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+void taskTicksToTimespec(task_time_t ticks, struct timespec *ts) {
+    ts->tv_sec = ticks / TASK_TICKS_PER_SECOND;
+    ts->tv_nsec = (long)((uint64_t)(ticks % TASK_TICKS_PER_SECOND) * 1000000000ULL / TASK_TICKS_PER_SECOND);
+}
+
+bool taskPollUntil(int fd, task_time_t now, task_time_t until) {
+    struct timespec delay = { 0, 0 };
+    if (taskTimeBefore(now, until)) {
+        taskTicksToTimespec(until - now, &delay);
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += delay.tv_sec;
+    end.tv_nsec += delay.tv_nsec;
+    if (end.tv_nsec >= 1000000000L) {
+        end.tv_sec++;
+        end.tv_nsec -= 1000000000L;
+    }
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    int n;
+    while ((n = ppoll(&pfd, 1, &delay, 0)) < 0 && errno == EINTR) {
+        // ppoll() is never restarted; sleep again for what is left.
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        delay.tv_sec = end.tv_sec - ts.tv_sec;
+        delay.tv_nsec = end.tv_nsec - ts.tv_nsec;
+        if (delay.tv_nsec < 0) {
+            delay.tv_sec--;
+            delay.tv_nsec += 1000000000L;
+        }
+        if (delay.tv_sec < 0) {
+            return false;
+        }
+    }
+    return n > 0;
+}
+
+void LinuxSleepIdle::idle(task_time_t now, task_time_t until) {
+    if (!taskTimeBefore(now, until)) {
+        return;
+    }
+    struct timespec ts, delay;
+    taskTicksToTimespec(until - now, &delay);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += delay.tv_sec;
+    ts.tv_nsec += delay.tv_nsec;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    // EINTR means a signal arrived - return and let the scheduler look.
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0);
+}
+
+LinuxEventIdle::LinuxEventIdle() :
+  fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+}
+
+LinuxEventIdle::~LinuxEventIdle() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void LinuxEventIdle::idle(task_time_t now, task_time_t until) {
+    if (taskPollUntil(fd, now, until)) {
+        // Consume the wake-ups; several wake() calls collapse into one.
+        uint64_t count;
+        if (read(fd, &count, sizeof(count)) < 0) {
+            return;
+        }
+    }
+}
+
+void LinuxEventIdle::wake() {
+    // write() is async-signal-safe.  A full counter is already a wake-up.
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0) {
+        return;
+    }
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Idle hooks - what the scheduler does when no task can run.
+ */
+
+#ifndef TaskIdle_h
+#define TaskIdle_h
+
+#include <stdint.h>
+#include "TaskClock.h"
+
+/*
+ * An (abstract) idle hook.  When a pass of the scheduler finds nothing to
+ * run, it works out when the next TimedTask is due and hands that to the
+ * hook, which should block until then or until woken, whichever is first.
+ */
+class IdleHook {
+
+public:
+    /*
+     * Block until the given time, or until wake() is called.  It is always
+     * safe to return early - the scheduler just makes another pass.
+     * now - current time, in clock ticks.
+     * until - the time the next TimedTask is due, in clock ticks.
+     */
+    virtual void idle(task_time_t now, task_time_t until) = 0;
+
+    /*
+     * End the current (or next) call to idle() early.  Safe to call from an
+     * ISR.  The default does nothing, for hooks that wake on any interrupt.
+     */
+    virtual void wake() {}
+};
+
+#if defined(__AVR__)
+
+/*
+ * Puts the MCU into SLEEP_MODE_IDLE between tasks.  Timer 0 keeps running in
+ * idle mode, so the clock still advances and the timer 0 tick ends each nap;
+ * the hook keeps napping until the deadline is reached or wake() is called.
+ * setRunnable() on a registered TriggeredTask calls wake(); an ISR that
+ * makes a task runnable some other way should call TaskScheduler::wake().
+ */
+class AvrSleepIdle : public IdleHook {
+
+public:
+    inline AvrSleepIdle() : woken(false) {}
+    virtual void idle(task_time_t now, task_time_t until);
+    virtual void wake();
+
+private:
+    volatile bool woken;    // Set by wake(), cleared by idle().
+};
+
+#endif
+
+#if defined(__linux__)
+
+#include <time.h>
+
+/*
+ * Convert a delay in clock ticks to a timespec.
+ */
+void taskTicksToTimespec(task_time_t ticks, struct timespec *ts);
+
+/*
+ * Wait for a descriptor to become readable, going back to sleep when a
+ * signal interrupts the wait - e.g. a PreemptiveTier tick - so only the
+ * descriptor or the deadline ends it.
+ * fd - the descriptor.
+ * now - current time, in clock ticks.
+ * until - when to give up, in clock ticks.
+ * return - true if the descriptor is readable.
+ */
+bool taskPollUntil(int fd, task_time_t now, task_time_t until);
+
+/*
+ * Sleeps the calling thread with clock_nanosleep() on CLOCK_MONOTONIC.  A
+ * signal delivered to the thread (e.g. a handler that triggers a task)
+ * interrupts the sleep, but wake() does nothing: a setRunnable() from
+ * another thread, or one just before the sleep starts, goes unseen until
+ * the next TimedTask is due.  Use LinuxEventIdle if triggers must wake it.
+ * Every signal ends the sleep, SA_RESTART or not - with a PreemptiveTier
+ * running, every tick, so the scheduler makes a pass per tick.
+ */
+class LinuxSleepIdle : public IdleHook {
+
+public:
+    virtual void idle(task_time_t now, task_time_t until);
+};
+
+/*
+ * Blocks in poll() on an eventfd, so that wake() - and with it setRunnable()
+ * on a TriggeredTask - can end the sleep from any thread or signal handler.
+ * Other signals, such as PreemptiveTier ticks, don't end it.
+ */
+class LinuxEventIdle : public IdleHook {
+
+public:
+    LinuxEventIdle();
+    ~LinuxEventIdle();
+    virtual void idle(task_time_t now, task_time_t until);
+    virtual void wake();
+
+    /*
+     * Get the eventfd, e.g. to wait on it alongside other descriptors.
+     */
+    inline int getFd() { return fd; }
+
+private:
+    int fd;     // The eventfd.
+};
+
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * A preemptive tier of tasks, run from a periodic timer interrupt.
+ */
+
+#include "TaskPreempt.h"
+
+#if defined(TASK_PREEMPT)
+
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+// Let other interrupts in while a tier task runs, and shut them out again.
+#define TIER_UNMASK() sei()
+#define TIER_MASK() cli()
+#elif defined(__linux__)
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static void tierSignal(int sig, sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, sig);
+}
+
+#define TIER_UNMASK() do { sigset_t s; tierSignal(TASK_PREEMPT_SIGNAL, &s); pthread_sigmask(SIG_UNBLOCK, &s, 0); } while (0)
+#define TIER_MASK() do { sigset_t s; tierSignal(TASK_PREEMPT_SIGNAL, &s); pthread_sigmask(SIG_BLOCK, &s, 0); } while (0)
+#endif
+
+PreemptiveTier *volatile PreemptiveTier::active = 0;
+
+PreemptiveTier::PreemptiveTier(Task **_tasks, task_count_t _numTasks) :
+  tasks(_tasks),
+  numTasks(_numTasks),
+  running(_numTasks),
+  ticks(0),
+  runs(0) {
+}
+
+/*
+ * Run every task that can run and outranks the one interrupted, if that
+ * was a tier task.  Entered with interrupts - on Linux, the tier's signal -
+ * masked.
+ */
+void PreemptiveTier::dispatch() {
+    task_count_t outer = running;
+    for (task_count_t t = 0; t < outer; t++) {
+        Task *tp = tasks[t];
+        task_time_t now = taskClockNow();
+        if (tp->canRun(now)) {
+            running = t;
+            TIER_UNMASK();
+            tp->run(now);
+            TIER_MASK();
+            running = outer;
+            taskAtomicAdd(&runs, (uint32_t)1);
+        }
+    }
+}
+
+void PreemptiveTier::handleTick() {
+    PreemptiveTier *tier = active;
+    if (tier) {
+        taskAtomicAdd(&tier->ticks, (uint32_t)1);
+        tier->dispatch();
+    }
+}
+
+#if defined(__AVR__)
+
+ISR(TIMER2_COMPA_vect) {
+    PreemptiveTier::handleTick();
+}
+
+bool PreemptiveTier::start(uint32_t hz) {
+    // Timer2's prescalers, by CS22:0 setting.
+    static const uint16_t prescale[] = { 1, 8, 32, 64, 128, 256, 1024 };
+    uint8_t cs;
+    uint32_t top = 0;
+    for (cs = 0; cs < 7; cs++) {
+        top = F_CPU / ((uint32_t)prescale[cs] * hz);
+        if (top <= 256) {
+            break;
+        }
+    }
+    if (!hz || cs == 7 || top == 0) {
+        return false;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        active = this;
+        TCCR2A = (1 << WGM21);      // CTC, count up to OCR2A.
+        TCCR2B = cs + 1;
+        TCNT2 = 0;
+        OCR2A = top - 1;
+        TIFR2 = (1 << OCF2A);
+        TIMSK2 |= (1 << OCIE2A);
+    }
+    return true;
+}
+
+void PreemptiveTier::stop() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TIMSK2 &= ~(1 << OCIE2A);
+        TCCR2B = 0;
+        active = 0;
+    }
+}
+
+void PreemptiveTier::kick() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (active == this) {
+            dispatch();
+        }
+    }
+}
+
+#elif defined(__linux__)
+
+static void tierHandler(int sig) {
+    PreemptiveTier::handleTick();
+}
+
+bool PreemptiveTier::start(uint32_t hz) {
+    if (!hz || hz > 1000000000UL) {
+        return false;
+    }
+    thread = syscall(SYS_gettid);
+    active = this;
+
+    // The signal stays masked while the handler runs, until dispatch()
+    // lets it in around each task.
+    struct sigaction sa;
+    sa.sa_handler = tierHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(TASK_PREEMPT_SIGNAL, &sa, &saved) != 0) {
+        active = 0;
+        return false;
+    }
+
+    struct sigevent sev;
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = TASK_PREEMPT_SIGNAL;
+    sev.sigev_value.sival_ptr = 0;
+    sev.sigev_notify_thread_id = thread;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &timer) != 0) {
+        sigaction(TASK_PREEMPT_SIGNAL, &saved, 0);
+        active = 0;
+        return false;
+    }
+
+    struct itimerspec its;
+    its.it_interval.tv_sec = 1 / hz;
+    its.it_interval.tv_nsec = 1000000000UL / hz % 1000000000UL;
+    its.it_value = its.it_interval;
+    timer_settime(timer, 0, &its, 0);
+    return true;
+}
+
+void PreemptiveTier::stop() {
+    if (active != this) {
+        return;
+    }
+    timer_delete(timer);
+    sigaction(TASK_PREEMPT_SIGNAL, &saved, 0);
+    active = 0;
+}
+
+void PreemptiveTier::kick() {
+    // Unless started, the signal has no handler, and would end the process.
+    if (taskAtomicLoad(&active) == this) {
+        syscall(SYS_tgkill, getpid(), thread, TASK_PREEMPT_SIGNAL);
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * A preemptive tier of tasks, run from a periodic timer interrupt.
+ */
+
+/*
+ * Build with TASK_PREEMPT.  On every tick of a timer interrupt - Timer2 on
+ * AVR, a POSIX timer signal on Linux - the tier runs any of its tasks that
+ * can run, interrupting the cooperative scheduler:
+ *
+ *     Task *critical[] = { &motorControl, &encoder };
+ *     PreemptiveTier tier(critical, NUM_TASKS(critical));
+ *     tier.start(1000);           // 1 kHz - at most 1 ms late.
+ *     scheduler.runTasks();       // Everything else, as before.
+ *
+ * Tier tasks run in interrupt context, so must be short and mustn't block,
+ * and aren't added to a TaskScheduler.
+ */
+
+#ifndef TaskPreempt_h
+#define TaskPreempt_h
+
+#include "Task.h"
+#include "TaskAtomic.h"
+
+#if defined(TASK_PREEMPT)
+
+#if defined(__linux__)
+#include <signal.h>
+#include <time.h>
+
+// Signal the timer delivers on Linux.
+#ifndef TASK_PREEMPT_SIGNAL
+#define TASK_PREEMPT_SIGNAL SIGRTMIN
+#endif
+#endif
+
+class PreemptiveTier {
+
+public:
+    /*
+     * Create a tier.  The highest priority task is first in the array.
+     * task - array of task pointers.
+     * numTasks - number of tasks in the array.
+     */
+    PreemptiveTier(Task **task, task_count_t numTasks);
+
+    /*
+     * Start the timer.  Only one tier can be started at a time.  On AVR it
+     * takes over Timer2, so Timer2 PWM and tone() are unavailable.  On
+     * Linux the tier runs on the calling thread, and each tick ends an
+     * idle hook's sleep early.
+     * hz - ticks per second.
+     * return - false if the timer can't tick at that rate, or couldn't be
+     *   set up.
+     */
+    bool start(uint32_t hz);
+
+    /*
+     * Stop the timer.
+     */
+    void stop();
+
+    /*
+     * Poll the tier as soon as possible rather than at the next tick, e.g.
+     * from an ISR that has just made a tier task runnable.  May be called
+     * from any context, but does nothing unless the tier is started.
+     */
+    void kick();
+
+    /*
+     * Get the number of ticks taken, and of tier task runs.
+     */
+    inline uint32_t getTicks() { return taskAtomicLoad(&ticks); }
+    inline uint32_t getRuns() { return taskAtomicLoad(&runs); }
+
+    /*
+     * Called from the timer interrupt.  Not for general use.
+     */
+    static void handleTick();
+
+private:
+    void dispatch();
+
+    static PreemptiveTier *volatile active; // The tier the timer is driving.
+
+    Task **tasks;                   // The tasks, in priority order.
+    task_count_t numTasks;          // Number of tasks.
+    volatile task_count_t running;  // Priority of the task running, or numTasks.
+    volatile uint32_t ticks;        // Ticks taken.
+    volatile uint32_t runs;         // Tier task runs.
+#if defined(__linux__)
+    timer_t timer;                  // The POSIX timer.
+    pid_t thread;                   // Thread the timer signals.
+    struct sigaction saved;         // Handler displaced by start().
+#endif
+};
+
+#endif
+
+#endif
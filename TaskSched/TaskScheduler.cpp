@@ -3,30 +3,690 @@
  * Use is subject to license terms.
  */
 
-#if ARDUINO < 100
-#include <WProgram.h>
-#else
-#include <Arduino.h>
+#include "TaskScheduler.h"
+#include "TaskAtomic.h"
+
+TaskScheduler::TaskScheduler(Task **tasks, task_count_t _numTasks, TimerWheel *_wheel) :
+  numTasks(0),
+  allHead(0),
+  allTail(0),
+  wheel(_wheel),
+  polled(0),
+  polledTail(0),
+  walkPolled(0),
+  walkEntry(0),
+  running(0),
+  idleTask(0),
+  idleHook(0),
+  policy(DISPATCH_PRIORITY),
+  weights(0),
+  numWeights(0),
+  cursor(0),
+  turns(0) {
+#if defined(TASK_EDF)
+    deadlineMisses = 0;
+#endif
+#if defined(TASK_DEADLINE_TABLE)
+    table = 0;
 #endif
+    // Each task's priority is its position in the array.
+    for (task_count_t t = 0; t < _numTasks; t++) {
+        add(*tasks[t], t);
+    }
+}
 
-#include "TaskScheduler.h"
+TaskScheduler::TaskScheduler(TimerWheel *_wheel) :
+  numTasks(0),
+  allHead(0),
+  allTail(0),
+  wheel(_wheel),
+  polled(0),
+  polledTail(0),
+  walkPolled(0),
+  walkEntry(0),
+  running(0),
+  idleTask(0),
+  idleHook(0),
+  policy(DISPATCH_PRIORITY),
+  weights(0),
+  numWeights(0),
+  cursor(0),
+  turns(0) {
+#if defined(TASK_EDF)
+    deadlineMisses = 0;
+#endif
+#if defined(TASK_DEADLINE_TABLE)
+    table = 0;
+#endif
+}
+
+void TaskScheduler::add(Task &task, task_count_t priority) {
+    Task *tp = &task;
+    tp->priority = priority;
 
-TaskScheduler::TaskScheduler(Task **_tasks, uint8_t _numTasks) :
-  tasks(_tasks),
-  numTasks(_numTasks) {
+    // Into the list of all tasks, after any of the same priority.
+    Task *after = allTail;
+    while (after && after->priority > priority) {
+        after = after->allPrev;
+    }
+    tp->allPrev = after;
+    tp->allNext = after ? after->allNext : allHead;
+    if (tp->allNext) {
+        tp->allNext->allPrev = tp;
+    } else {
+        allTail = tp;
+    }
+    if (after) {
+        after->allNext = tp;
+    } else {
+        allHead = tp;
+    }
+    numTasks++;
+
+    // TriggeredTasks point back at the scheduler, so that setRunnable() can
+    // wake it.
+    TriggeredTask *gtp = tp->asTriggeredTask();
+    if (gtp) {
+        taskAtomicStore(&gtp->scheduler, this);
+    }
+    tp->registered(this);
+    schedule(tp);
+}
+
+/*
+ * Put a task where dispatch() looks for it.  TriggeredTasks wait to be
+ * queued by setRunnable().  TimedTasks go onto the wheel if there is one,
+ * or else into the deadline table if there is one and they fit.  Everything
+ * else is polled.  Also files timers that aren't registered tasks, e.g. a
+ * CoroutineAlarm.
+ */
+void TaskScheduler::schedule(Task *tp) {
+    TimedTask *ttp = tp->asTimedTask();
+    TriggeredTask *gtp = tp->asTriggeredTask();
+    if (gtp) {
+        if (gtp->runFlag) {
+            gtp->trigger(this);
+        }
+        return;
+    }
+    if (wheel && ttp) {
+        wheel->add(ttp);
+        return;
+    }
+
+#if defined(TASK_DEADLINE_TABLE)
+    if (table && ttp && table->add(ttp)) {
+        // Keep the place of a dispatch walk under way.
+        if (table->indexOf(ttp) < walkEntry) {
+            walkEntry++;
+        }
+        return;
+    }
+#endif
+    linkPolled(tp);
 }
 
+/*
+ * Insert a task into the polled list, after any of the same priority.
+ */
+void TaskScheduler::linkPolled(Task *tp) {
+    Task *after = polledTail;
+    while (after && after->priority > tp->priority) {
+        after = after->prev;
+    }
+    tp->prev = after;
+    tp->next = after ? after->next : polled;
+    if (tp->next) {
+        tp->next->prev = tp;
+    } else {
+        polledTail = tp;
+    }
+    if (after) {
+        after->next = tp;
+    } else {
+        polled = tp;
+    }
+}
+
+void TaskScheduler::remove(Task &task) {
+    Task *tp = &task;
+    if (tp->allPrev) {
+        tp->allPrev->allNext = tp->allNext;
+    } else {
+        allHead = tp->allNext;
+    }
+    if (tp->allNext) {
+        tp->allNext->allPrev = tp->allPrev;
+    } else {
+        allTail = tp->allPrev;
+    }
+    tp->allNext = tp->allPrev = 0;
+    numTasks--;
+    if (tp == running) {
+        running = 0;
+    }
+
+    TriggeredTask *gtp = tp->asTriggeredTask();
+    if (gtp) {
+        taskAtomicStore(&gtp->scheduler, (TaskScheduler *)0);
+    }
+    tp->registered(0);
+    unschedule(tp);
+}
+
+/*
+ * Take a task off wherever schedule() put it.
+ */
+void TaskScheduler::unschedule(Task *tp) {
+    TimedTask *ttp = tp->asTimedTask();
+    TriggeredTask *gtp = tp->asTriggeredTask();
+    if (gtp) {
+        // It may be part way to the ready bitmap - finish the journey,
+        // then take it off.
+        drainReady();
+        if (taskAtomicLoad(&gtp->queued)) {
+            ready.unlink(gtp);
+            taskAtomicStore(&gtp->queued, false);
+        }
+        return;
+    }
+    if (wheel && ttp) {
+        wheel->remove(ttp);
+        return;
+    }
+
+#if defined(TASK_DEADLINE_TABLE)
+    if (ttp && ttp->tableEntry) {
+        if (table->indexOf(ttp) < walkEntry) {
+            walkEntry--;
+        }
+        table->remove(ttp);
+        return;
+    }
+#endif
+    unlinkPolled(tp);
+}
+
+void TaskScheduler::unlinkPolled(Task *tp) {
+    // A dispatch walk due to visit the task moves on to the next.
+    if (tp == walkPolled) {
+        walkPolled = tp->next;
+    }
+    if (tp->prev) {
+        tp->prev->next = tp->next;
+    } else {
+        polled = tp->next;
+    }
+    if (tp->next) {
+        tp->next->prev = tp->prev;
+    } else {
+        polledTail = tp->prev;
+    }
+    tp->next = tp->prev = 0;
+}
+
+#if defined(TASK_DEADLINE_TABLE)
+void TaskScheduler::setDeadlineTable(DeadlineTable *_table) {
+    if (wheel) {
+        return;
+    }
+    table = _table;
+    Task *np;
+    for (Task *tp = polled; tp; tp = np) {
+        np = tp->next;
+        TimedTask *ttp = tp->asTimedTask();
+        if (ttp && table->add(ttp)) {
+            unlinkPolled(tp);
+        }
+    }
+}
+#endif
+
 void TaskScheduler::runTasks() {
     while (1) {
-        uint32_t now = millis();
-        Task **tpp = tasks;
-        for (int t = 0; t < numTasks; t++) {
-            Task *tp = *tpp;
-            if (tp->canRun(now)) {
-                tp->run(now);
+        task_time_t now = taskClockNow();
+        bool ran = dispatch(now);
+        if (!ran && idleHook) {
+#if defined(TASK_TRACE)
+            taskTrace.record(TRACE_IDLE);
+#endif
+#if defined(TASK_STATS)
+            task_time_t start = taskClockNow();
+            idleHook->idle(now, nextWakeTime());
+            stats.idleTime += (task_time_t)(taskClockNow() - start);
+#else
+            idleHook->idle(now, nextWakeTime());
+#endif
+#if defined(TASK_TRACE)
+            taskTrace.record(TRACE_WAKE);
+#endif
+        }
+    }
+}
+
+bool TaskScheduler::dispatch(task_time_t now) {
+    if (wheel) {
+        wheel->advance(now);
+    }
+    drainReady();
+
+    task_count_t p;
+    bool ran = false;
+    switch (policy) {
+    case DISPATCH_PRIORITY:
+        ran = runFirst(now, 0, TASK_PRIORITY_END, false) != TASK_PRIORITY_END;
+        break;
+
+    case DISPATCH_ALL_READY:
+        // One walk down the priorities, running everything that can run.
+        ran = runFirst(now, 0, TASK_PRIORITY_END, true) != TASK_PRIORITY_END;
+        break;
+
+    case DISPATCH_ROUND_ROBIN:
+        // Start from the task whose turn it is, wrapping around.
+        if ((p = runFirst(now, cursor, TASK_PRIORITY_END, false)) == TASK_PRIORITY_END) {
+            p = runFirst(now, 0, cursor, false);
+        }
+        if (p != TASK_PRIORITY_END) {
+            nextTurn(p);
+            ran = true;
+        }
+        break;
+
+#if defined(TASK_EDF)
+    case DISPATCH_EDF:
+        ran = runEarliest(now) != 0;
+        break;
+#endif
+    }
+
+    // Nothing else could run - the idle task's turn.
+    bool ranIdle = false;
+    if (!ran && idleTask && pollTask(idleTask, now)) {
+        runTask(idleTask, now);
+        ranIdle = true;
+    }
+
+#if defined(TASK_STATS)
+    if (ran) {
+        countStarved(now);
+    }
+    stats.passes++;
+    if (!ran) {
+        stats.idlePasses++;
+    }
+#endif
+    return ran || ranIdle;
+}
+
+void TaskScheduler::setPolicy(DispatchPolicy _policy, const uint8_t *_weights, task_count_t _numWeights) {
+    policy = _policy;
+    weights = _weights;
+    numWeights = _weights ? _numWeights : 0;
+    cursor = 0;
+    turns = 0;
+}
+
+/*
+ * Run the first task in priority order, from priority 'from' up to but not
+ * including 'to', that can run - or with 'all', every one that can.
+ *
+ * The candidates come from the polled list, the wheel's due tasks, the
+ * ready bitmap of triggered tasks and the deadline table's due entries.
+ * Each is in priority order - the bitmaps find their first at or below
+ * 'from' without walking past the others, and findDue() skips entries that
+ * aren't due without touching their tasks - so walking them together
+ * visits candidates in the same order as the array would.  While a task
+ * runs, the walk's place is kept in walkPolled, each bitmap's cursor and
+ * walkEntry, which remove() moves on should run() take the task there off.
+ * return - the priority of the (first) task run, or TASK_PRIORITY_END if
+ *   none was.
+ */
+task_count_t TaskScheduler::runFirst(task_time_t now, task_count_t from, task_count_t to, bool all) {
+    ReadyBitmap *maps[2] = { wheel ? &wheel->due() : 0, &ready };
+    Task *heads[3] = { polled, maps[0] ? maps[0]->first(from) : 0, maps[1]->first(from) };
+    while (heads[0] && heads[0]->priority < from) {
+        heads[0] = heads[0]->next;
+    }
+#if defined(TASK_DEADLINE_TABLE)
+    task_count_t i = table ? table->findDue(now, table->seek(from)) : 0;
+#endif
+    task_count_t first = TASK_PRIORITY_END;
+    while (1) {
+        Task *cp = 0;
+        uint8_t c = 0;
+        for (uint8_t h = 0; h < 3; h++) {
+            if (heads[h] && (!cp || heads[h]->priority < cp->priority)) {
+                cp = heads[h];
+                c = h;
+            }
+        }
+#if defined(TASK_DEADLINE_TABLE)
+        if (table && i < table->getCount() && (!cp || table->getPriority(i) < cp->priority)) {
+            cp = table->getTask(i);
+            c = 3;
+        }
+#endif
+        if (!cp || cp->priority >= to) {
+            break;
+        }
+        if (c < 3) {
+            heads[c] = c ? maps[c - 1]->next(cp) : cp->next;
+        }
+#if defined(TASK_DEADLINE_TABLE)
+        if (c == 3) {
+            i = table->findDue(now, i + 1);
+        }
+#endif
+
+        if (pollTask(cp, now)) {
+            if (first == TASK_PRIORITY_END) {
+                first = cp->priority;
+            }
+            walkPolled = heads[0];
+            if (maps[0]) {
+                maps[0]->setCursor(heads[1]);
+            }
+            maps[1]->setCursor(heads[2]);
+#if defined(TASK_DEADLINE_TABLE)
+            walkEntry = i;
+#endif
+            // Unless run() removed it.
+            if (runTask(cp, now) && c == 2) {
+                retire(static_cast<TriggeredTask *>(cp));
+            }
+            heads[0] = walkPolled;
+            walkPolled = 0;
+            if (maps[0]) {
+                heads[1] = maps[0]->getCursor();
+                maps[0]->setCursor(0);
+            }
+            heads[2] = maps[1]->getCursor();
+            maps[1]->setCursor(0);
+#if defined(TASK_DEADLINE_TABLE)
+            // The entry may have been removed, or its run time changed.
+            if (table) {
+                i = table->findDue(now, walkEntry);
+            }
+            walkEntry = 0;
+#endif
+            if (!all) {
                 break;
             }
-            tpp++;
+        } else if (c == 2) {
+            retire(static_cast<TriggeredTask *>(cp));
+        }
+    }
+    return first;
+}
+
+#if defined(TASK_EDF)
+/*
+ * Earliest deadline first - poll every candidate, and run the one whose
+ * deadline is soonest.  Tasks without a deadline come after those with
+ * one, and ties go by priority.
+ * return - the task that was run, or NULL.
+ */
+Task *TaskScheduler::runEarliest(task_time_t now) {
+    Task *best = 0;
+    ReadyBitmap *maps[2] = { wheel ? &wheel->due() : 0, &ready };
+    for (uint8_t h = 0; h < 3; h++) {
+        if (h && !maps[h - 1]) {
+            continue;
+        }
+        Task *np;
+        for (Task *tp = h ? maps[h - 1]->first() : polled; tp; tp = np) {
+            np = h ? maps[h - 1]->next(tp) : tp->next;
+            if (!pollTask(tp, now)) {
+                tp->released = false;
+                if (h == 2) {
+                    retire(static_cast<TriggeredTask *>(tp));
+                }
+                continue;
+            }
+            release(tp, now);
+            if (!best || earlier(tp, best)) {
+                best = tp;
+            }
+        }
+    }
+#if defined(TASK_DEADLINE_TABLE)
+    if (table) {
+        task_count_t count = table->getCount();
+        for (task_count_t i = table->findDue(now, 0); i < count; i = table->findDue(now, i + 1)) {
+            Task *tp = table->getTask(i);
+            if (!pollTask(tp, now)) {
+                tp->released = false;
+                continue;
+            }
+            release(tp, now);
+            if (!best || earlier(tp, best)) {
+                best = tp;
+            }
+        }
+    }
+#endif
+    if (!best) {
+        return 0;
+    }
+
+    // Unless run() removed it.
+    TriggeredTask *gtp = best->asTriggeredTask();
+    if (runTask(best, now) && gtp) {
+        retire(gtp);
+    }
+    return best;
+}
+
+/*
+ * Should runnable task a go before b?  Tasks with a deadline go before those
+ * without, earlier deadlines first, and otherwise by priority.
+ */
+inline bool TaskScheduler::earlier(Task *a, Task *b) {
+    if (a->deadline && b->deadline) {
+        return taskTimeBefore(a->absDeadline, b->absDeadline) ||
+          (a->absDeadline == b->absDeadline && a->priority < b->priority);
+    }
+    return a->deadline || (!b->deadline && a->priority < b->priority);
+}
+
+/*
+ * Note that a task has become runnable, and work out its deadline - for a
+ * TimedTask from when it was due, for anything else from when it was seen.
+ */
+void TaskScheduler::release(Task *tp, task_time_t now) {
+    if (tp->released) {
+        return;
+    }
+    TimedTask *ttp = tp->asTimedTask();
+    tp->absDeadline = (ttp ? ttp->getRunTime() : now) + tp->deadline;
+    tp->released = true;
+}
+#endif
+
+/*
+ * Round robin - move the turn on once a task has had as many runs in a row
+ * as its weight.
+ */
+void TaskScheduler::nextTurn(task_count_t priority) {
+    if (priority != cursor) {
+        cursor = priority;
+        turns = 0;
+    }
+    uint8_t weight = cursor < numWeights ? weights[cursor] : 1;
+    if (++turns >= weight) {
+        cursor++;
+        turns = 0;
+    }
+}
+
+#if defined(TASK_STATS)
+/*
+ * After a pass that ran something, count every task that could also have
+ * run but didn't.  Only the candidates a pass would look at are asked -
+ * the polled list, the wheel's due tasks, the ready bitmap and the deadline
+ * table's due entries - so a TimedTask still on the wheel, or a
+ * TriggeredTask waiting for a trigger, costs nothing here.
+ */
+void TaskScheduler::countStarved(task_time_t now) {
+    for (Task *tp = polled; tp; tp = tp->next) {
+        countStarved(tp, now);
+    }
+    ReadyBitmap *maps[2] = { wheel ? &wheel->due() : 0, &ready };
+    for (uint8_t m = 0; m < 2; m++) {
+        if (maps[m]) {
+            for (Task *tp = maps[m]->first(); tp; tp = maps[m]->next(tp)) {
+                countStarved(tp, now);
+            }
+        }
+    }
+#if defined(TASK_DEADLINE_TABLE)
+    if (table) {
+        for (task_count_t i = table->findDue(now, 0); i < table->getCount(); i = table->findDue(now, i + 1)) {
+            countStarved(table->getTask(i), now);
+        }
+    }
+#endif
+}
+
+/*
+ * Count a pass that ran others while a task could have run.
+ */
+void TaskScheduler::countStarved(Task *task, task_time_t now) {
+    if (task->stats.lastPass != stats.passes && task->canRun(now)) {
+        task->stats.recordStarved(stats.passes);
+    }
+}
+
+void TaskScheduler::resetStats() {
+    for (Task *tp = allHead; tp; tp = tp->allNext) {
+        tp->stats.reset();
+    }
+    stats.reset(taskClockNow());
+}
+#endif
+
+/*
+ * Ask a task whether it can run, counting the poll if keeping statistics.
+ */
+inline bool TaskScheduler::pollTask(Task *tp, task_time_t now) {
+#if defined(TASK_STATS)
+    tp->stats.polls++;
+#endif
+    return tp->canRun(now);
+}
+
+/*
+ * Run a task, timing it if keeping statistics, checking its deadline if it
+ * has one and tracing it if recording.  The task isn't touched after run()
+ * if run() removed it.
+ * return - false if run() removed the task.
+ */
+inline bool TaskScheduler::runTask(Task *tp, task_time_t now) {
+#if defined(TASK_EDF)
+    release(tp, now);
+#endif
+#if defined(TASK_TRACE)
+    task_count_t priority = tp->priority;
+    taskTrace.record(TRACE_RUN, priority);
+#endif
+#if defined(TASK_STATS)
+    TimedTask *ttp = tp->asTimedTask();
+    task_time_t late = ttp && taskTimeReached(now, ttp->getRunTime()) ? now - ttp->getRunTime() : 0;
+    task_time_t start = taskClockNow();
+#endif
+    // remove() clears 'running' if it is given the task.
+    Task *outer = running;
+    running = tp;
+    tp->run(now);
+    bool kept = running == tp;
+    running = outer;
+#if defined(TASK_STATS)
+    task_time_t elapsed = taskClockNow() - start;
+    stats.busyTime += elapsed;
+    if (kept) {
+        tp->stats.recordRun(elapsed, late);
+        tp->stats.lastPass = stats.passes;
+        tp->stats.starving = 0;
+    }
+#endif
+#if defined(TASK_EDF)
+    if (kept) {
+        if (tp->deadline && taskTimeBefore(tp->absDeadline, taskClockNow())) {
+            tp->deadlineMisses++;
+            deadlineMisses++;
+        }
+        tp->released = false;
+    }
+#endif
+#if defined(TASK_TRACE)
+    taskTrace.record(TRACE_DONE, priority);
+#endif
+    return kept;
+}
+
+void TaskScheduler::enqueue(TriggeredTask *task) {
+    readyQueue.push(task);
+    wake();
+}
+
+void TaskScheduler::wake() {
+    if (idleHook) {
+        idleHook->wake();
+    }
+}
+
+task_time_t TaskScheduler::nextWakeTime() {
+    task_time_t now = taskClockNow();
+    if (wheel) {
+        wheel->advance(now);
+        return wheel->nextExpiry(now);
+    }
+
+    // No wheel, so look at the TimedTasks being polled and in the table -
+    // alarms that aren't registered tasks included.
+    task_time_t until = now + TASK_TIME_HORIZON;
+    for (Task *tp = polled; tp; tp = tp->next) {
+        TimedTask *ttp = tp->asTimedTask();
+        if (ttp && taskTimeBefore(ttp->getRunTime(), until)) {
+            until = ttp->getRunTime();
+        }
+    }
+#if defined(TASK_DEADLINE_TABLE)
+    for (task_count_t i = 0; table && i < table->getCount(); i++) {
+        if (taskTimeBefore(table->getTask(i)->getRunTime(), until)) {
+            until = table->getTask(i)->getRunTime();
         }
     }
+#endif
+    return taskTimeReached(now, until) ? now : until;
+}
+
+/*
+ * Move triggered tasks from the ready queue onto the ready bitmap.
+ */
+void TaskScheduler::drainReady() {
+    ReadyLink *rlp;
+    while ((rlp = readyQueue.pop()) != 0) {
+        ready.link(static_cast<TriggeredTask *>(rlp));
+    }
+}
+
+/*
+ * Take a triggered task off the ready bitmap once it has been reset - a
+ * task that is still runnable stays on, just as it would keep passing
+ * canRun() when polled.
+ */
+void TaskScheduler::retire(TriggeredTask *task) {
+    if (task->runFlag) {
+        return;
+    }
+    ready.unlink(task);
+
+    // setRunnable() may have landed after run() reset the flag, and seen
+    // the task still queued - if so, put it straight back.
+    taskAtomicStore(&task->queued, false);
+    if (taskAtomicLoad(&task->runFlag) && !taskAtomicExchange(&task->queued, true)) {
+        ready.link(task);
+    }
 }
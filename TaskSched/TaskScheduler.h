@@ -11,21 +11,90 @@
 #define TaskScheduler_h
 
 #include "Task.h"
+#include "TimerWheel.h"
+#include "DeadlineTable.h"
+#include "TaskIdle.h"
 
 // Calculate the number of tasks in the array, given the size.
-#define NUM_TASKS(T) (sizeof(T) / sizeof(Task))
+#define NUM_TASKS(T) (sizeof(T) / sizeof(T[0]))
 
 class TaskScheduler {
 
 public:
+    /*
+     * How dispatch() picks what to run.
+     *   DISPATCH_PRIORITY - run the highest priority task that can run,
+     *     one per pass.  The original behaviour, and the default.
+     *   DISPATCH_ALL_READY - run every task that can run, in priority
+     *     order, in one pass with one reading of the clock - each once,
+     *     tasks of equal priority included.  A busy high priority task can
+     *     then delay the others by at most one run.
+     *   DISPATCH_ROUND_ROBIN - take turns, in priority order.  A task keeps
+     *     its turn for up to its weight runs in a row, then the next task
+     *     that can run gets one.
+     *   DISPATCH_EDF - with TASK_EDF, run the task that can run whose
+     *     deadline (see Task::setDeadline()) is earliest, ties going to the
+     *     higher priority.  Every candidate is polled on every pass.
+     */
+    enum DispatchPolicy {
+        DISPATCH_PRIORITY,
+        DISPATCH_ALL_READY,
+        DISPATCH_ROUND_ROBIN,
+#if defined(TASK_EDF)
+        DISPATCH_EDF
+#endif
+    };
+
     /*
      * Create a new task scheduler.  Tasks are scheduled in priority order,
      * where the highest priority task is first in the array, and the lowest
-     * priority task is the last.
+     * priority task is the last - each task is add()ed with its position in
+     * the array as its priority.
      * task - array of task pointers.
      * numTasks - number of tasks in the array.
+     * wheel - optional timer wheel.  If given, TimedTasks are dispatched
+     *   from the wheel instead of being polled with canRun() on every pass.
+     *   TriggeredTasks are dispatched from a ready queue fed by
+     *   setRunnable() either way.
+     */
+    TaskScheduler(Task **task, task_count_t numTasks, TimerWheel *wheel = 0);
+
+    /*
+     * Create a task scheduler with no tasks, for tasks to be add()ed later.
+     * wheel - optional timer wheel, as above.
+     */
+    TaskScheduler(TimerWheel *wheel = 0);
+
+    /*
+     * Register a task.  The scheduler links it into its lists through
+     * Task's own links, so nothing is allocated.  Polled tasks of equal
+     * priority are polled in the order they were added; the order of
+     * TriggeredTasks, and of TimedTasks on a wheel, is unspecified.  O(1)
+     * when the task goes after all the others, e.g. everything at one
+     * priority or added lowest priority last; otherwise it steps back over
+     * the tasks of lower priority.
+     * task - the task, which must not already be registered.
+     * priority - 0 is the highest, TASK_PRIORITY_END - 1 the lowest.
+     */
+    void add(Task &task, task_count_t priority);
+
+    /*
+     * Unregister a task, in O(1).  It is no longer polled or run, and may
+     * then be destroyed.  May be called from within run(), including the
+     * task's own.  Don't call setRunnable() on it from another thread or an
+     * ISR while it is being removed.
+     * task - the task, which must be registered.
+     */
+    void remove(Task &task);
+
+    /*
+     * Take a task out of scheduling until resume(), keeping its priority.
+     * A TimedTask keeps its runTime, so on resume() it runs straight away
+     * if that has passed.  A TriggeredTask remembers setRunnable().  To
+     * suspend several tasks at once, see TaskGroup.h.
      */
-    TaskScheduler(Task **task, uint8_t numTasks);
+    inline void suspend(Task &task) { remove(task); }
+    inline void resume(Task &task) { add(task, task.priority); }
 
     /*
      * Start the task scheduler running.  Never returns.
@@ -33,9 +102,150 @@ public:
      */
     void runTasks();
 
+    /*
+     * Make a single pass over the tasks, running the highest priority one
+     * that can run.  For driving the scheduler from somewhere other than
+     * runTasks(), e.g. loop() or a test harness.
+     * now - current time, in clock ticks.
+     * return - true if a task was run.
+     */
+    bool dispatch(task_time_t now);
+
+    /*
+     * Choose how tasks are picked.  See TaskStats::starved for how much
+     * each policy holds tasks back.
+     * policy - the dispatch policy.
+     * weights - for DISPATCH_ROUND_ROBIN, runs per turn for each priority,
+     *   indexed by priority - with the array constructor, one per task in
+     *   the same order.  NULL means one each.  Tasks of equal priority share
+     *   a turn.
+     * numWeights - number of weights; priorities past the end get one run.
+     */
+    void setPolicy(DispatchPolicy policy, const uint8_t *weights, task_count_t numWeights);
+    inline void setPolicy(DispatchPolicy policy) { setPolicy(policy, 0, 0); }
+
+#if defined(TASK_DEADLINE_TABLE)
+    /*
+     * Keep TimedTasks' run times in a table, to be scanned in bulk rather
+     * than each task polled - see DeadlineTable.h.  Only without a wheel.
+     * Moves any TimedTasks already added into the table, as far as they fit.
+     * table - the table, which must be empty.
+     */
+    void setDeadlineTable(DeadlineTable *table);
+#endif
+
+    /*
+     * Set a task to run on passes where no other task can, whatever the
+     * policy, before runTasks() calls the idle hook - e.g. a Debugger.  It
+     * is polled on each such pass, and must not also be add()ed.
+     * task - the idle task, or NULL for none.
+     */
+    inline void setIdleTask(Task *task) { idleTask = task; }
+
+    /*
+     * Set the hook runTasks() calls when no task can run, instead of
+     * spinning.  The hook is given nextWakeTime() as its deadline.
+     * hook - the idle hook, or NULL to spin.
+     */
+    inline void setIdleHook(IdleHook *hook) { idleHook = hook; }
+
+    /*
+     * Wake the scheduler from its idle hook, e.g. from an ISR that has
+     * just triggered a task.
+     */
+    void wake();
+
+    /*
+     * Get the earliest time any TimedTask is due to run.
+     * return - the time, in clock ticks.  This is the current time if a
+     *   task is already due, or TASK_TIME_HORIZON ticks from now if there
+     *   are no TimedTasks.
+     */
+    task_time_t nextWakeTime();
+
+    /*
+     * Get the number of registered tasks, and walk them in priority order -
+     * e.g. for a Debugger task to dump their statistics:
+     *
+     *     for (Task *tp = sched.getFirstTask(); tp; tp = sched.getNextTask(tp))
+     */
+    inline task_count_t getNumTasks() { return numTasks; }
+    inline Task *getFirstTask() { return allHead; }
+    inline Task *getNextTask(Task *tp) { return tp->allNext; }
+
+#if defined(TASK_EDF)
+    /*
+     * Get the number of runs, across all tasks, that finished after their
+     * deadline.  Counted whatever the policy.
+     */
+    inline uint32_t getDeadlineMisses() { return deadlineMisses; }
+#endif
+
+#if defined(TASK_STATS)
+    /*
+     * Get the scheduler-wide statistics.  Per-task statistics are in
+     * Task::getStats().
+     */
+    inline SchedulerStats &getStats() { return stats; }
+
+    /*
+     * Clear the statistics of the scheduler and all of its tasks.
+     */
+    void resetStats();
+#endif
+
 private:
-    Task **tasks;   // Array of task pointers.
-    int numTasks;   // Number of tasks in the array.
+    friend class TriggeredTask;
+    friend class CoroutineAlarm;
+
+    void enqueue(TriggeredTask *task);
+    bool pollTask(Task *tp, task_time_t now);
+    bool runTask(Task *tp, task_time_t now);
+    task_count_t runFirst(task_time_t now, task_count_t from, task_count_t to, bool all);
+    void nextTurn(task_count_t priority);
+#if defined(TASK_EDF)
+    Task *runEarliest(task_time_t now);
+    bool earlier(Task *a, Task *b);
+    void release(Task *tp, task_time_t now);
+#endif
+#if defined(TASK_STATS)
+    void countStarved(task_time_t now);
+    void countStarved(Task *task, task_time_t now);
+#endif
+    void drainReady();
+    void retire(TriggeredTask *task);
+    void schedule(Task *tp);
+    void unschedule(Task *tp);
+    void linkPolled(Task *tp);
+    void unlinkPolled(Task *tp);
+
+    task_count_t numTasks;  // Number of registered tasks.
+    Task *allHead;          // All registered tasks, in priority order.
+    Task *allTail;
+    TimerWheel *wheel;      // Timer wheel for TimedTasks, if any.
+    Task *polled;           // Tasks polled every pass, in priority order -
+    Task *polledTail;       //   those not on the wheel, table or bitmap.
+    ReadyBitmap ready;      // Triggered tasks taken off the ready queue.
+    Task *walkPolled;       // Next polled task of a dispatch walk.
+    task_count_t walkEntry; // Next due table entry of a dispatch walk.
+    Task *running;          // Task in run(), until it is removed.
+    Task *idleTask;         // Run when nothing else can, if set.
+#if defined(TASK_DEADLINE_TABLE)
+    DeadlineTable *table;   // Run times of TimedTasks not polled, if set.
+#endif
+    ReadyQueue readyQueue;  // Triggered tasks waiting to be picked up.
+    IdleHook *idleHook;     // Called when nothing can run, if set.
+    DispatchPolicy policy;  // How dispatch() picks tasks.
+    const uint8_t *weights; // Round robin runs per turn, if set.
+    task_count_t numWeights;    // Number of weights.
+    task_count_t cursor;    // Round robin - whose turn it is.
+    uint8_t turns;          // Round robin - runs taken this turn.
+#if defined(TASK_EDF)
+    uint32_t deadlineMisses;    // Runs that finished after their deadline.
+#endif
+#if defined(TASK_STATS)
+    SchedulerStats stats;   // Scheduler-wide statistics.
+#endif
 };
 
 #endif
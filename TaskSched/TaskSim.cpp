@@ -0,0 +1,110 @@
+/*
+ * Discrete-event simulation of a task set on the virtual clock.
+ */
+
+#include "TaskSim.h"
+
+#if defined(TASK_CLOCK_VIRTUAL)
+
+TaskSimulator::TaskSimulator(TaskScheduler &_sched) :
+  sched(_sched),
+  numEvents(0),
+  nextEvent(0),
+  runs(0),
+  jumps(0) {
+}
+
+bool TaskSimulator::inject(task_time_t when, TriggeredTask &task, uint8_t source,
+  task_time_t every, uint32_t count) {
+    Event ev = { when, every, count, &task, 0, 0, source };
+    return add(ev);
+}
+
+bool TaskSimulator::inject(task_time_t when, void (*fn)(void *arg), void *arg,
+  task_time_t every, uint32_t count) {
+    Event ev = { when, every, count, 0, fn, arg, 0 };
+    return add(ev);
+}
+
+bool TaskSimulator::add(Event &ev) {
+    if (numEvents >= TASK_SIM_EVENTS) {
+        return false;
+    }
+    if (!numEvents || taskTimeBefore(ev.when, nextEvent)) {
+        nextEvent = ev.when;
+    }
+    events[numEvents++] = ev;
+    return true;
+}
+
+/*
+ * Fire every event that is due, rescheduling repeats, and work out which
+ * is due next.
+ */
+void TaskSimulator::fireDue(task_time_t now) {
+    if (!numEvents || taskTimeBefore(now, nextEvent)) {
+        return;
+    }
+    uint8_t i = 0;
+    while (i < numEvents) {
+        Event &ev = events[i];
+        bool done = false;
+        while (taskTimeReached(now, ev.when)) {
+            if (ev.task) {
+                ev.task->setRunnable(ev.source);
+            } else {
+                ev.fn(ev.arg);
+            }
+            if (!ev.every || (ev.remaining && --ev.remaining == 0)) {
+                done = true;
+                break;
+            }
+            ev.when += ev.every;
+        }
+        if (done) {
+            events[i] = events[--numEvents];
+        } else {
+            i++;
+        }
+    }
+    for (i = 0; i < numEvents; i++) {
+        if (i == 0 || taskTimeBefore(events[i].when, nextEvent)) {
+            nextEvent = events[i].when;
+        }
+    }
+}
+
+void TaskSimulator::runUntil(task_time_t end) {
+    task_time_t now;
+    while (taskTimeBefore(now = taskClockNow(), end)) {
+        fireDue(now);
+        if (sched.dispatch(now)) {
+            runs++;
+            continue;
+        }
+
+        // Nothing to do - jump to whatever happens next.
+        task_time_t next = sched.nextWakeTime();
+        if (numEvents && taskTimeBefore(nextEvent, next)) {
+            next = nextEvent;
+        }
+        if (taskTimeBefore(end, next)) {
+            next = end;
+        }
+        if (!taskTimeBefore(now, next)) {
+            // Something is due but won't run yet - e.g. a canRun() that
+            // checks more than the time.  Let a tick pass.
+            next = now + 1;
+        }
+#if defined(TASK_TRACE)
+        taskTrace.record(TRACE_IDLE);
+#endif
+        taskClockSet(next);
+        jumps++;
+#if defined(TASK_TRACE)
+        taskTrace.record(TRACE_WAKE);
+#endif
+    }
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Discrete-event simulation of a task set on the virtual clock.
+ */
+
+/*
+ * Build with TASK_CLOCK_VIRTUAL and drive the scheduler from a
+ * TaskSimulator instead of runTasks().  Whenever a pass finds nothing to
+ * run, the clock jumps straight to the next TimedTask deadline or injected
+ * event, so a simulated day of a typical sketch takes milliseconds:
+ *
+ *     TaskSimulator sim(scheduler);
+ *     // The tilt switch's PCINT2 interrupt, once an hour from 1 minute in.
+ *     sim.inject(60000, tiltTask, 2, 3600000UL, 0);
+ *     sim.runFor(24UL * 3600 * 1000);
+ *
+ * Injected events either trigger a TriggeredTask, as its ISR would, or
+ * call a function, which can stand in for any other outside change - a pin
+ * reading, a byte arriving.  run() takes no simulated time unless the task
+ * moves the clock itself with taskClockSet(), so a task that is always
+ * runnable stops the clock; model its cost that way.
+ *
+ * With TASK_TRACE, each jump is recorded as an idle spell.
+ */
+
+#ifndef TaskSim_h
+#define TaskSim_h
+
+#include "TaskScheduler.h"
+
+#if defined(TASK_CLOCK_VIRTUAL)
+
+// Most injected events pending at once.
+#ifndef TASK_SIM_EVENTS
+#define TASK_SIM_EVENTS 32
+#endif
+
+class TaskSimulator {
+
+public:
+    TaskSimulator(TaskScheduler &sched);
+
+    /*
+     * Trigger a task at a given time, and optionally again at a fixed
+     * interval.
+     * when - time of the first trigger, in clock ticks.
+     * task - the task, whose setRunnable() is called.
+     * source - trigger source passed to setRunnable(), e.g. an interrupt
+     *   number.
+     * every - ticks between repeats, or 0 for none.
+     * count - number of triggers in all, or 0 for no limit.
+     * return - false if too many events are already pending.
+     */
+    bool inject(task_time_t when, TriggeredTask &task, uint8_t source = 0,
+      task_time_t every = 0, uint32_t count = 1);
+
+    /*
+     * Call a function at a given time, and optionally again at a fixed
+     * interval.
+     * fn - the function, passed arg.
+     * Otherwise as above.
+     */
+    bool inject(task_time_t when, void (*fn)(void *arg), void *arg = 0,
+      task_time_t every = 0, uint32_t count = 1);
+
+    /*
+     * Run the task set until the clock reaches a given time.  Events and
+     * tasks due at exactly that time are left for the next call.
+     * end - the time to stop, in clock ticks.
+     */
+    void runUntil(task_time_t end);
+
+    /*
+     * Run the task set for a number of ticks.
+     */
+    inline void runFor(task_time_t ticks) { runUntil(taskClockNow() + ticks); }
+
+    /*
+     * Throw away all pending events.
+     */
+    inline void clear() { numEvents = 0; }
+
+    /*
+     * Get the number of passes that ran a task, and of clock jumps.
+     */
+    inline uint32_t getRuns() { return runs; }
+    inline uint32_t getJumps() { return jumps; }
+
+private:
+    struct Event {
+        task_time_t when;           // When the event is next due.
+        task_time_t every;          // Ticks between repeats, or 0.
+        uint32_t remaining;         // Firings left, or 0 for no limit.
+        TriggeredTask *task;        // Task to trigger, or NULL.
+        void (*fn)(void *arg);      // Else function to call.
+        void *arg;
+        uint8_t source;             // Trigger source.
+    };
+
+    bool add(Event &ev);
+    void fireDue(task_time_t now);
+
+    TaskScheduler &sched;           // The scheduler being driven.
+    Event events[TASK_SIM_EVENTS];  // Pending events, unordered.
+    uint8_t numEvents;              // Number of pending events.
+    task_time_t nextEvent;          // Earliest pending event, if any.
+    uint32_t runs;                  // Passes that ran a task.
+    uint32_t jumps;                 // Times the clock was moved on.
+};
+
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Optional run-time statistics for tasks and the scheduler.
+ */
+
+#include "TaskStats.h"
+
+#if defined(TASK_STATS)
+
+void TaskStats::reset() {
+    runs = 0;
+    polls = 0;
+    minRun = (task_time_t)-1;
+    maxRun = 0;
+    totalRun = 0;
+    maxLate = 0;
+    totalLate = 0;
+    starved = 0;
+    maxStarved = 0;
+    starving = 0;
+    lastPass = (uint32_t)-1;
+    starvedPass = (uint32_t)-1;
+}
+
+void TaskStats::recordRun(task_time_t elapsed, task_time_t late) {
+    runs++;
+    if (elapsed < minRun) {
+        minRun = elapsed;
+    }
+    if (elapsed > maxRun) {
+        maxRun = elapsed;
+    }
+    totalRun += elapsed;
+    if (late > maxLate) {
+        maxLate = late;
+    }
+    totalLate += late;
+}
+
+void TaskStats::recordStarved(uint32_t pass) {
+    starved++;
+    if (pass != starvedPass + 1) {
+        starving = 0;
+    }
+    starvedPass = pass;
+    if (++starving > maxStarved) {
+        maxStarved = starving;
+    }
+}
+
+void SchedulerStats::reset(task_time_t now) {
+    passes = 0;
+    idlePasses = 0;
+    busyTime = 0;
+    idleTime = 0;
+    since = now;
+}
+
+uint16_t SchedulerStats::utilization(task_time_t now) {
+    uint64_t elapsed = (task_time_t)(now - since);
+    if (elapsed == 0) {
+        return 0;
+    }
+    uint64_t busy = busyTime > elapsed ? elapsed : busyTime;
+    return (uint16_t)(busy * 10000 / elapsed);
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Optional run-time statistics for tasks and the scheduler.
+ */
+
+/*
+ * Enabled by TASK_STATS in TaskConfig.h.  When it is off none of this is
+ * compiled in and tasks are no bigger.  All times are in clock ticks, so
+ * execution times are only as fine as the clock - with the default
+ * millisecond clock most run() calls will measure 0, TASK_CLOCK_MICROS
+ * gives a more useful picture.
+ *
+ * Counting starved passes costs, after each pass that ran something, a
+ * canRun() call on every task that pass could have picked: the polled
+ * tasks, and those due or triggered.  Tasks waiting on the wheel or for a
+ * trigger aren't asked.
+ */
+
+#ifndef TaskStats_h
+#define TaskStats_h
+
+#include "TaskClock.h"
+
+#if defined(TASK_STATS)
+
+/*
+ * Statistics for a single task.
+ */
+class TaskStats {
+
+public:
+    inline TaskStats() { reset(); }
+
+    /*
+     * Clear all the counters.
+     */
+    void reset();
+
+    /*
+     * Record a call to run().
+     * elapsed - how long run() took, in ticks.
+     * late - how long after its runTime a TimedTask was run, otherwise 0.
+     */
+    void recordRun(task_time_t elapsed, task_time_t late);
+
+    /*
+     * Record a pass in which the task could have run, but didn't.
+     * pass - the scheduler's pass number.
+     */
+    void recordStarved(uint32_t pass);
+
+    /*
+     * Mean time spent in run(), in ticks.
+     */
+    inline task_time_t meanRun() { return runs ? (task_time_t)(totalRun / runs) : 0; }
+
+    /*
+     * Mean lateness of a TimedTask, in ticks.
+     */
+    inline task_time_t meanLate() { return runs ? (task_time_t)(totalLate / runs) : 0; }
+
+    uint32_t runs;          // Times run() was called.
+    uint32_t polls;         // Times canRun() was called.
+    task_time_t minRun;     // Shortest run().
+    task_time_t maxRun;     // Longest run().
+    uint64_t totalRun;      // Total time in run().
+    task_time_t maxLate;    // Latest dispatch of a TimedTask.
+    uint64_t totalLate;     // Total lateness of a TimedTask.
+    uint32_t starved;       // Passes that ran others while this could run.
+    uint32_t maxStarved;    // Most such passes in a row.
+    uint32_t starving;      // Such passes in a row, up to starvedPass.
+    uint32_t lastPass;      // Scheduler pass it last ran in.
+    uint32_t starvedPass;   // Scheduler pass it was last starved in.
+};
+
+/*
+ * Statistics for the scheduler as a whole.
+ */
+class SchedulerStats {
+
+public:
+    inline SchedulerStats() { reset(taskClockNow()); }
+
+    /*
+     * Clear all the counters.
+     * now - the time counting starts from.
+     */
+    void reset(task_time_t now);
+
+    /*
+     * Share of the time since reset() spent running tasks.
+     * now - current time, in ticks.
+     * return - utilization, in hundredths of a percent (0 - 10000).
+     */
+    uint16_t utilization(task_time_t now);
+
+    uint32_t passes;        // Passes made over the tasks.
+    uint32_t idlePasses;    // Passes that found nothing but the idle task.
+    uint64_t busyTime;      // Time spent in run().
+    uint64_t idleTime;      // Time spent in the idle hook.
+    task_time_t since;      // When the counters were reset.
+};
+
+#endif
+
+#endif
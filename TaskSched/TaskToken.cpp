@@ -0,0 +1,134 @@
+/*
+ * Tokenized log messages.
+ */
+
+#include "TaskToken.h"
+
+#if defined(TASK_LOG_TOKENS)
+
+TaskTokenBuf::TaskTokenBuf(TaskToken token) :
+  len(0),
+  full(false) {
+    putByte(token.id);
+    putByte(token.id >> 8);
+}
+
+void TaskTokenBuf::putByte(uint8_t b) {
+    if (len < TASK_LOG_LINE) {
+        buf[len++] = b;
+    } else {
+        full = true;
+    }
+}
+
+void TaskTokenBuf::putInt(uint32_t v) {
+    while (v >= 0x80) {
+        putByte((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    putByte(v);
+}
+
+void TaskTokenBuf::putStr(const char *s) {
+    // Cut the string short rather than lose its NUL.
+    while (*s && len < TASK_LOG_LINE - 1) {
+        buf[len++] = *s++;
+    }
+    putByte('\0');
+}
+
+uint8_t TaskTokenBuf::finish() {
+    return full ? 0 : len;
+}
+
+#else
+
+TaskTokenBuf::TaskTokenBuf(TaskToken token) :
+  len(0),
+  fmt(token.fmt) {
+}
+
+/*
+ * Add a character of text, leaving room for the NUL.
+ */
+void TaskTokenBuf::putByte(uint8_t b) {
+    if (len < TASK_LOG_LINE - 1) {
+        buf[len++] = b;
+    }
+}
+
+/*
+ * Copy the format string up to its next conversion.
+ * return - the conversion character, or '\0' at the end of the string.
+ */
+char TaskTokenBuf::nextConversion() {
+    while (*fmt) {
+        char c = *fmt++;
+        if (c == '%' && *fmt) {
+            c = *fmt++;
+            if (c != '%') {
+                return c;
+            }
+        }
+        putByte(c);
+    }
+    return '\0';
+}
+
+void TaskTokenBuf::putNum(uint32_t v, uint8_t base, char ten) {
+    char digits[10];
+    uint8_t d = 0;
+    do {
+        uint8_t digit = v % base;
+        digits[d++] = digit < 10 ? '0' + digit : ten + digit - 10;
+        v /= base;
+    } while (v);
+    while (d) {
+        putByte(digits[--d]);
+    }
+}
+
+void TaskTokenBuf::putInt(uint32_t v) {
+    switch (nextConversion()) {
+    case '\0':
+        // More arguments than conversions.
+        break;
+    case 'd':
+    case 'i':
+        if ((int32_t)v < 0) {
+            putByte('-');
+            v = 0 - v;
+        }
+        putNum(v, 10, 'a');
+        break;
+    case 'x':
+        putNum(v, 16, 'a');
+        break;
+    case 'X':
+        putNum(v, 16, 'A');
+        break;
+    case 'c':
+        putByte(v);
+        break;
+    default:
+        putNum(v, 10, 'a');
+        break;
+    }
+}
+
+void TaskTokenBuf::putStr(const char *s) {
+    if (!nextConversion()) {
+        return;
+    }
+    while (*s) {
+        putByte(*s++);
+    }
+}
+
+uint8_t TaskTokenBuf::finish() {
+    nextConversion();
+    buf[len++] = '\0';
+    return len;
+}
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * Tokenized log messages.
+ */
+
+/*
+ * TASK_TOKEN("Light Level: %d") stands for a printf-style format string in
+ * a Debugger message:
+ *
+ *     ptrDebugger->debugWrite(TASK_TOKEN("Light Level: %d"), lightLevel);
+ *
+ * With TASK_LOG_TOKENS defined (see TaskConfig.h) the string is hashed at
+ * compile time into a 16 bit ID and is never stored on the device.  The
+ * message goes out as the ID followed by the arguments packed in binary -
+ * a couple of bytes where the text would take tens.  The host tool in
+ * extras/tokens builds a table of IDs by scanning the sources for
+ * TASK_TOKEN, and uses it to turn the stream back into text.  Without
+ * TASK_LOG_TOKENS the same calls format the text on the device.
+ *
+ * The format must be a single string literal, and the arguments must match
+ * its conversions: %d, %i, %u, %x, %X and %c for integers of up to 32 bits
+ * and %s for strings, plus %% - no flags, widths or precisions.
+ *
+ * On the wire each message is its ID, low byte first, then each argument:
+ * an integer as its 32 bit two's complement value in base 128, low 7 bits
+ * first with the top bit of each byte set if more follow, and a string as
+ * its characters and a NUL.  ID 0 is untokenized text - one string
+ * argument, as sent for plain debugWrite() calls.
+ */
+
+#ifndef TaskToken_h
+#define TaskToken_h
+
+#include <stdint.h>
+#include "TaskConfig.h"
+#include "LogRing.h"
+
+/*
+ * 32 bit FNV-1a hash of a string, at compile time.
+ */
+constexpr uint32_t taskTokenHash(const char *s, uint32_t h = 2166136261UL) {
+    return *s ? taskTokenHash(s + 1, (h ^ (uint8_t)*s) * 16777619UL) : h;
+}
+
+/*
+ * Fold a hash to a 16 bit ID, keeping clear of 0.
+ */
+constexpr uint16_t taskTokenFold(uint32_t h) {
+    return (uint16_t)(h ^ (h >> 16)) ? (uint16_t)(h ^ (h >> 16)) : 1;
+}
+
+/*
+ * The ID of a format string.
+ */
+constexpr uint16_t taskTokenId(const char *fmt) {
+    return taskTokenFold(taskTokenHash(fmt));
+}
+
+/*
+ * Forces an ID to be worked out at compile time, so the string itself is
+ * never emitted.
+ */
+template <uint16_t ID>
+struct TaskTokenId {
+    enum { value = ID };
+};
+
+/*
+ * A format string, as an ID or as text.  Made by TASK_TOKEN().
+ */
+class TaskToken {
+
+public:
+#if defined(TASK_LOG_TOKENS)
+    explicit inline TaskToken(uint16_t _id) : id(_id) {}
+
+    uint16_t id;        // Hash of the format string.
+#else
+    explicit inline TaskToken(const char *_fmt) : fmt(_fmt) {}
+
+    const char *fmt;    // The format string.
+#endif
+};
+
+#if defined(TASK_LOG_TOKENS)
+#define TASK_TOKEN(fmt) TaskToken(TaskTokenId<taskTokenId(fmt)>::value)
+#else
+#define TASK_TOKEN(fmt) TaskToken(fmt)
+#endif
+
+/*
+ * Builds one message - packed, or formatted as text - from a token and its
+ * arguments.
+ */
+class TaskTokenBuf {
+
+public:
+    TaskTokenBuf(TaskToken token);
+
+    inline void put(char v) { putInt((uint32_t)v); }
+    inline void put(signed char v) { putInt((uint32_t)v); }
+    inline void put(unsigned char v) { putInt((uint32_t)v); }
+    inline void put(short v) { putInt((uint32_t)v); }
+    inline void put(unsigned short v) { putInt((uint32_t)v); }
+    inline void put(int v) { putInt((uint32_t)v); }
+    inline void put(unsigned int v) { putInt((uint32_t)v); }
+    inline void put(long v) { putInt((uint32_t)v); }
+    inline void put(unsigned long v) { putInt((uint32_t)v); }
+    inline void put(const char *s) { putStr(s); }
+
+    /*
+     * Add the next argument.
+     */
+    void putInt(uint32_t v);
+    void putStr(const char *s);
+
+    /*
+     * Finish the message.
+     * return - its length, or 0 if the arguments didn't fit in a message.
+     *   Text never overflows, it is just cut short.
+     */
+    uint8_t finish();
+
+    inline uint8_t *getData() { return buf; }
+
+private:
+    void putByte(uint8_t b);
+#if !defined(TASK_LOG_TOKENS)
+    char nextConversion();
+    void putNum(uint32_t v, uint8_t base, char ten);
+#endif
+
+    uint8_t buf[TASK_LOG_LINE];     // The message.
+    uint8_t len;                    // Bytes used.
+#if defined(TASK_LOG_TOKENS)
+    bool full;                      // Something didn't fit.
+#else
+    const char *fmt;                // Rest of the format string.
+#endif
+};
+
+/*
+ * Add arguments to a message, in order.
+ */
+inline void taskTokenPut(TaskTokenBuf &) {}
+
+template <typename T, typename... Rest>
+inline void taskTokenPut(TaskTokenBuf &b, T first, Rest... rest) {
+    b.put(first);
+    taskTokenPut(b, rest...);
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Dispatch trace recorder.
+ */
+
+#include "TaskTrace.h"
+#include "TaskAtomic.h"
+
+#if defined(TASK_TRACE)
+
+#if !defined(ARDUINO)
+#include <stdio.h>
+#endif
+
+TaskTrace taskTrace;
+
+TaskTrace::TaskTrace() :
+  head(0),
+  full(false),
+  enabled(true) {
+}
+
+void TaskTrace::record(uint8_t type, uint16_t task, uint8_t arg) {
+    if (!enabled) {
+        return;
+    }
+    unsigned i = taskAtomicAdd(&head, 1U) - 1;
+    TaskTraceEvent &ev = events[i & (TASK_TRACE_EVENTS - 1)];
+    ev.time = (uint32_t)taskClockNow();
+    ev.task = task;
+    ev.type = type;
+    ev.arg = arg;
+    if (i == TASK_TRACE_EVENTS - 1) {
+        full = true;
+    }
+}
+
+unsigned TaskTrace::getCount() {
+    return full ? TASK_TRACE_EVENTS : taskAtomicLoad(&head);
+}
+
+TaskTraceEvent TaskTrace::getEvent(unsigned i) {
+    return events[(taskAtomicLoad(&head) - getCount() + i) & (TASK_TRACE_EVENTS - 1)];
+}
+
+void TaskTrace::clear() {
+    taskAtomicStore(&full, false);
+    taskAtomicStore(&head, 0U);
+}
+
+/*
+ * The dump is a header line giving the clock rate and event count, then
+ * one line per event, oldest first: time, type letter, task and argument.
+ *
+ *     # tasktrace 1000 3
+ *     10500 R 2 0
+ *     10502 D 2 0
+ *     10502 I 0 0
+ */
+#if defined(ARDUINO)
+
+void TaskTrace::dump(Print &out) {
+    bool was = enabled;
+    enabled = false;
+    unsigned count = getCount();
+    out.print("# tasktrace ");
+    out.print((unsigned long)TASK_TICKS_PER_SECOND);
+    out.print(' ');
+    out.println(count);
+    for (unsigned i = 0; i < count; i++) {
+        TaskTraceEvent ev = getEvent(i);
+        out.print(ev.time);
+        out.print(' ');
+        out.print((char)ev.type);
+        out.print(' ');
+        out.print(ev.task);
+        out.print(' ');
+        out.println(ev.arg);
+    }
+    enabled = was;
+}
+
+#else
+
+void TaskTrace::dump(int fd) {
+    bool was = enabled;
+    enabled = false;
+    unsigned count = getCount();
+    dprintf(fd, "# tasktrace %lu %u\n", (unsigned long)TASK_TICKS_PER_SECOND, count);
+    for (unsigned i = 0; i < count; i++) {
+        TaskTraceEvent ev = getEvent(i);
+        dprintf(fd, "%lu %c %u %u\n", (unsigned long)ev.time, ev.type, ev.task, ev.arg);
+    }
+    enabled = was;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Dispatch trace recorder.
+ */
+
+/*
+ * With TASK_TRACE defined, the scheduler records what it does into a fixed
+ * ring of compact events, overwriting the oldest: the start and end of each
+ * run(), each setRunnable() with its source, and each spell in the idle
+ * hook.  Dump the ring with taskTrace.dump(), e.g. from a Debugger command
+ * once something has gone wrong, and the tool in extras/trace turns the
+ * dump into Chrome trace-event JSON, which chrome://tracing and Perfetto
+ * (ui.perfetto.dev) both open as a timeline.
+ *
+ * Times are clock ticks, cut to 32 bits.  Runs shorter than a tick show up
+ * with no length, so TASK_CLOCK_MICROS suits tracing better than the default
+ * millis().  Tasks are identified by priority.
+ *
+ * record() is safe from any context, as setRunnable() may be called from an
+ * ISR or another thread.  An event being written while dump() reads the
+ * ring can come out garbled, so dump() stops recording while it runs.
+ */
+
+#ifndef TaskTrace_h
+#define TaskTrace_h
+
+#include <stdint.h>
+#include "TaskClock.h"
+
+// Number of events kept - a power of 2.  Each takes 8 bytes.
+#ifndef TASK_TRACE_EVENTS
+#if defined(__AVR__)
+#define TASK_TRACE_EVENTS 32
+#else
+#define TASK_TRACE_EVENTS 1024
+#endif
+#endif
+
+#if (TASK_TRACE_EVENTS & (TASK_TRACE_EVENTS - 1)) != 0
+#error "TaskTrace: TASK_TRACE_EVENTS must be a power of 2"
+#endif
+
+#if defined(TASK_TRACE)
+
+#if defined(ARDUINO)
+#if ARDUINO < 100
+#include <WProgram.h>
+#else
+#include <Arduino.h>
+#endif
+#endif
+
+/*
+ * What an event records.  The letters are used in dumps.
+ */
+enum TaskTraceType {
+    TRACE_RUN = 'R',        // run() called.
+    TRACE_DONE = 'D',       // run() returned.
+    TRACE_TRIGGER = 'T',    // setRunnable() called - arg is its source.
+    TRACE_IDLE = 'I',       // Idle hook entered.
+    TRACE_WAKE = 'W'        // Idle hook returned.
+};
+
+struct TaskTraceEvent {
+    uint32_t time;          // Clock ticks, low 32 bits.
+    uint16_t task;          // Task priority, if any.
+    uint8_t type;           // A TaskTraceType.
+    uint8_t arg;            // Trigger source.
+};
+
+class TaskTrace {
+
+public:
+    TaskTrace();
+
+    /*
+     * Record an event, stamped with the current time.  May be called from
+     * any context.
+     * type - a TaskTraceType.
+     * task - the task's priority.
+     * arg - event specific.
+     */
+    void record(uint8_t type, uint16_t task = 0, uint8_t arg = 0);
+
+    /*
+     * Start or stop recording, e.g. to keep the events leading up to a
+     * fault from being overwritten.  Recording starts on.
+     */
+    inline void setEnabled(bool on) { enabled = on; }
+    inline bool isEnabled() { return enabled; }
+
+    /*
+     * Get the number of events held, at most TASK_TRACE_EVENTS.
+     */
+    unsigned getCount();
+
+    /*
+     * Get an event.
+     * i - which, 0 being the oldest held.
+     */
+    TaskTraceEvent getEvent(unsigned i);
+
+    /*
+     * Throw away all the events held.
+     */
+    void clear();
+
+#if defined(ARDUINO)
+    /*
+     * Write the events held as text - see extras/trace for the format.
+     * out - where to write them, e.g. Serial.
+     */
+    void dump(Print &out);
+#else
+    /*
+     * Write the events held as text - see extras/trace for the format.
+     * fd - file descriptor to write them to.
+     */
+    void dump(int fd);
+#endif
+
+private:
+    TaskTraceEvent events[TASK_TRACE_EVENTS];   // The ring.
+    volatile unsigned head;     // Next event to write.
+    volatile bool full;         // The ring has wrapped.
+    volatile bool enabled;      // Recording.
+};
+
+// The recorder all schedulers share.
+extern TaskTrace taskTrace;
+
+#endif
+
+#endif
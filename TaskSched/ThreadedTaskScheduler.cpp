@@ -0,0 +1,272 @@
+/*
+ * A multi-threaded, work-stealing task scheduler for Linux hosts.
+ */
+
+#include "ThreadedTaskScheduler.h"
+#include "TaskAtomic.h"
+
+#if defined(__linux__)
+
+#include <time.h>
+
+/*
+ * A Chase-Lev work-stealing deque of claimed tasks.  The owning worker
+ * pushes and pops at the bottom, other workers steal from the top.  A task
+ * is claimed while it is on a deque, so it can be on at most one of them at
+ * a time, and a capacity of numTasks never overflows.
+ */
+class WorkDeque {
+
+public:
+    WorkDeque() : top(0), bottom(0), mask(0), buffer(0) {}
+    ~WorkDeque() { delete[] buffer; }
+
+    void init(task_count_t capacity) {
+        uint32_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        buffer = new Task *[size];
+    }
+
+    /*
+     * Owner only.
+     */
+    void push(Task *tp) {
+        int64_t b = __atomic_load_n(&bottom, __ATOMIC_RELAXED);
+        __atomic_store_n(&buffer[b & mask], tp, __ATOMIC_RELAXED);
+        __atomic_store_n(&bottom, b + 1, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Owner only.
+     */
+    Task *pop() {
+        int64_t b = __atomic_load_n(&bottom, __ATOMIC_RELAXED) - 1;
+        __atomic_store_n(&bottom, b, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int64_t t = __atomic_load_n(&top, __ATOMIC_RELAXED);
+        if (t > b) {
+            __atomic_store_n(&bottom, b + 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+        Task *tp = __atomic_load_n(&buffer[b & mask], __ATOMIC_RELAXED);
+        if (t == b) {
+            // Last entry - race any thief for it.
+            if (!__atomic_compare_exchange_n(&top, &t, t + 1, false,
+              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                tp = 0;
+            }
+            __atomic_store_n(&bottom, b + 1, __ATOMIC_RELAXED);
+        }
+        return tp;
+    }
+
+    /*
+     * Any worker.
+     */
+    Task *steal() {
+        int64_t t = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int64_t b = __atomic_load_n(&bottom, __ATOMIC_ACQUIRE);
+        if (t >= b) {
+            return 0;
+        }
+        Task *tp = __atomic_load_n(&buffer[t & mask], __ATOMIC_RELAXED);
+        if (!__atomic_compare_exchange_n(&top, &t, t + 1, false,
+          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+        return tp;
+    }
+
+private:
+    int64_t top;        // Next entry to steal.
+    int64_t bottom;     // Next free entry - owner only writes it.
+    uint32_t mask;      // Buffer size - 1.
+    Task **buffer;      // Ring of entries.
+};
+
+ThreadedTaskScheduler::ThreadedTaskScheduler(Task **_tasks, task_count_t _numTasks, unsigned _numWorkers) :
+  tasks(_tasks),
+  numTasks(_numTasks),
+  numWorkers(_numWorkers ? _numWorkers : 1),
+  polling(false),
+  stopping(false),
+  wakeups(0) {
+    workers = new Worker[numWorkers];
+    deques = new WorkDeque[numWorkers];
+    claimed = new uint8_t[numTasks];
+    pinnedTo = new int[numTasks];
+    for (unsigned w = 0; w < numWorkers; w++) {
+        workers[w].scheduler = this;
+        workers[w].index = w;
+        deques[w].init(numTasks);
+    }
+    for (task_count_t t = 0; t < numTasks; t++) {
+        tasks[t]->priority = t;
+        claimed[t] = false;
+        pinnedTo[t] = -1;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&idle, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&lock, 0);
+}
+
+ThreadedTaskScheduler::~ThreadedTaskScheduler() {
+    pthread_cond_destroy(&idle);
+    pthread_mutex_destroy(&lock);
+    delete[] pinnedTo;
+    delete[] claimed;
+    delete[] deques;
+    delete[] workers;
+}
+
+void ThreadedTaskScheduler::pin(Task *task, unsigned worker) {
+    pinnedTo[task->priority] = worker < numWorkers ? worker : 0;
+}
+
+void ThreadedTaskScheduler::runTasks() {
+    stopping = false;
+    for (unsigned w = 1; w < numWorkers; w++) {
+        pthread_create(&workers[w].thread, 0, workerMain, &workers[w]);
+    }
+    work(0);
+    for (unsigned w = 1; w < numWorkers; w++) {
+        pthread_join(workers[w].thread, 0);
+    }
+}
+
+void ThreadedTaskScheduler::stop() {
+    taskAtomicStore(&stopping, true);
+    wake();
+}
+
+void ThreadedTaskScheduler::wake() {
+    pthread_mutex_lock(&lock);
+    __atomic_add_fetch(&wakeups, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&idle);
+    pthread_mutex_unlock(&lock);
+}
+
+void *ThreadedTaskScheduler::workerMain(void *arg) {
+    Worker *wp = static_cast<Worker *>(arg);
+    wp->scheduler->work(wp->index);
+    return 0;
+}
+
+/*
+ * A worker's main loop: its pinned tasks first, then its own deque, then
+ * other workers' deques, and finally a fresh poll of the unpinned tasks.
+ */
+void ThreadedTaskScheduler::work(unsigned self) {
+    while (!taskAtomicLoad(&stopping)) {
+        uint32_t seen = taskAtomicLoad(&wakeups);
+        task_time_t now = taskClockNow();
+        if (runPinned(self, now)) {
+            continue;
+        }
+        Task *tp = deques[self].pop();
+        if (!tp) {
+            tp = steal(self);
+        }
+        if (tp) {
+            runClaimed(tp, taskClockNow());
+            continue;
+        }
+        if (!poll(self, now)) {
+            idleWait(seen);
+        }
+    }
+}
+
+/*
+ * Run the highest priority task pinned to this worker that can run.  Only
+ * this worker touches them, so they need no claim.
+ */
+bool ThreadedTaskScheduler::runPinned(unsigned self, task_time_t now) {
+    for (task_count_t t = 0; t < numTasks; t++) {
+        if (pinnedTo[t] == (int)self && tasks[t]->canRun(now)) {
+            tasks[t]->run(now);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Claim each free, unpinned task in turn and ask whether it can run - those
+ * that can go onto this worker's deque still claimed, the rest are released.
+ * Only one worker polls at a time; the others steal what it finds.
+ * return - true if anything was found.
+ */
+bool ThreadedTaskScheduler::poll(unsigned self, task_time_t now) {
+    if (taskAtomicExchange(&polling, true)) {
+        return false;
+    }
+    unsigned found = 0;
+    for (task_count_t t = numTasks; t-- > 0; ) {
+        if (pinnedTo[t] >= 0 || taskAtomicExchange(&claimed[t], (uint8_t)true)) {
+            continue;
+        }
+        if (tasks[t]->canRun(now)) {
+            deques[self].push(tasks[t]);
+            found++;
+        } else {
+            taskAtomicStore(&claimed[t], (uint8_t)false);
+        }
+    }
+    taskAtomicStore(&polling, false);
+    if (found > 1) {
+        wake();
+    }
+    return found != 0;
+}
+
+/*
+ * Take a task from another worker's deque, starting with the next worker
+ * along so that thieves spread out.
+ */
+Task *ThreadedTaskScheduler::steal(unsigned self) {
+    for (unsigned i = 1; i < numWorkers; i++) {
+        Task *tp = deques[(self + i) % numWorkers].steal();
+        if (tp) {
+            return tp;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Run a claimed task, then release it.
+ */
+void ThreadedTaskScheduler::runClaimed(Task *tp, task_time_t now) {
+    tp->run(now);
+    taskAtomicStore(&claimed[tp->priority], (uint8_t)false);
+}
+
+/*
+ * Wait for wake(), or THREADED_IDLE_NS - unless wake() has been called
+ * since the worker last looked for work.
+ */
+void ThreadedTaskScheduler::idleWait(uint32_t seen) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += THREADED_IDLE_NS;
+    while (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&lock);
+    if (taskAtomicLoad(&wakeups) == seen && !taskAtomicLoad(&stopping)) {
+        pthread_cond_timedwait(&idle, &lock, &ts);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * A multi-threaded, work-stealing task scheduler for Linux hosts.
+ */
+
+/*
+ * Takes the same Task** array as TaskScheduler, but runs tasks on a pool of
+ * worker threads so that CPU-heavy run() bodies can use every core.  Each
+ * worker owns a deque of runnable tasks.  A worker with nothing to do first
+ * steals from the other workers' deques, and if they are empty too, polls
+ * the tasks with canRun() - lowest priority first, so the highest priority
+ * task found ends up at the end of the deque its owner pops from, and the
+ * lower priority ones are the first to be stolen.
+ *
+ * A task is claimed before canRun() is called and released after run()
+ * returns, so neither is ever called on two threads at once, and everything
+ * one run() wrote is visible to the next, on whatever thread.  Tasks that
+ * must stay on one thread (e.g. ones driving Serial, like Debugger) can be
+ * pinned to a worker with pin(); that worker polls and runs them itself.
+ *
+ * Strict priority order only holds per worker - with N workers, up to N
+ * tasks run at once.  A TriggeredTask's setRunnable() is noticed on the next
+ * poll, which is at most THREADED_IDLE_NS away; call wake() after it for an
+ * immediate response.
+ */
+
+#ifndef ThreadedTaskScheduler_h
+#define ThreadedTaskScheduler_h
+
+#if defined(__linux__)
+
+#include <pthread.h>
+#include "Task.h"
+
+// Longest an idle worker sleeps before polling again, in nanoseconds.
+#ifndef THREADED_IDLE_NS
+#define THREADED_IDLE_NS 1000000
+#endif
+
+class WorkDeque;
+
+class ThreadedTaskScheduler {
+
+public:
+    /*
+     * Create a new task scheduler.  Tasks are in priority order, the
+     * highest priority first, as for TaskScheduler.
+     * task - array of task pointers.
+     * numTasks - number of tasks in the array.
+     * numWorkers - number of worker threads, including the one that calls
+     *   runTasks().
+     */
+    ThreadedTaskScheduler(Task **task, task_count_t numTasks, unsigned numWorkers);
+    ~ThreadedTaskScheduler();
+
+    /*
+     * Keep a task on one worker thread - it is then only ever polled and run
+     * by that worker.  Call before runTasks().
+     * task - the task, which must be one of the scheduler's.
+     * worker - the worker, 0 being the thread that calls runTasks().
+     */
+    void pin(Task *task, unsigned worker = 0);
+
+    /*
+     * Start the workers, running worker 0 on the calling thread.  Returns
+     * once stop() has been called and every worker has finished.
+     */
+    void runTasks();
+
+    /*
+     * Ask the workers to finish once their current run() returns.  Safe to
+     * call from any thread, including from within a task.
+     */
+    void stop();
+
+    /*
+     * Wake idle workers to poll again, e.g. after setRunnable() on a
+     * TriggeredTask from another thread.
+     */
+    void wake();
+
+    inline unsigned getNumWorkers() { return numWorkers; }
+
+private:
+    struct Worker {
+        ThreadedTaskScheduler *scheduler;
+        unsigned index;
+        pthread_t thread;
+    };
+
+    static void *workerMain(void *arg);
+    void work(unsigned self);
+    bool runPinned(unsigned self, task_time_t now);
+    bool poll(unsigned self, task_time_t now);
+    Task *steal(unsigned self);
+    void runClaimed(Task *tp, task_time_t now);
+    void idleWait(uint32_t seen);
+
+    Task **tasks;               // Array of task pointers.
+    task_count_t numTasks;      // Number of tasks in the array.
+    unsigned numWorkers;        // Number of worker threads.
+    Worker *workers;            // Per-worker thread state.
+    WorkDeque *deques;          // Per-worker runnable tasks.
+    volatile uint8_t *claimed;  // Per-task: polled or running somewhere.
+    int *pinnedTo;              // Per-task: owning worker, or -1.
+    volatile bool polling;      // A worker is polling the unpinned tasks.
+    volatile bool stopping;     // stop() has been called.
+    volatile uint32_t wakeups;  // Bumped by wake(), so sleepers can't miss one.
+    pthread_mutex_t lock;       // Guards sleeping.
+    pthread_cond_t idle;        // Signalled by wake().
+};
+
+#endif
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Hierarchical timer wheel - an optional back end for dispatching TimedTasks.
+ */
+
+#include "TimerWheel.h"
+
+// Pseudo-slots for tasks that are not in a wheel slot.
+#define WHEEL_SLOT_DUE      0xFE
+#define WHEEL_SLOT_OVERFLOW 0xFD
+
+// Index of the slot at the given level that covers time t, or -1 if the
+// level is beyond the width of the clock.
+static inline int8_t levelIndex(task_time_t t, uint8_t level) {
+    uint8_t shift = TIMER_WHEEL_SLOT_BITS * level;
+    return shift < TASK_TIME_BITS ? (int8_t)((t >> shift) & TIMER_WHEEL_MASK) : -1;
+}
+
+TimerWheel::TimerWheel(task_time_t now) :
+  current(now),
+  overflow(0),
+  count(0) {
+    for (uint8_t l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        occupied[l] = 0;
+        for (uint8_t s = 0; s < TIMER_WHEEL_SLOTS; s++) {
+            slots[l][s] = 0;
+        }
+    }
+}
+
+void TimerWheel::add(TimedTask *task) {
+    task->wheel = this;
+    file(task);
+    count++;
+}
+
+void TimerWheel::remove(TimedTask *task) {
+    unlink(task);
+    task->wheel = 0;
+    count--;
+}
+
+void TimerWheel::reschedule(TimedTask *task) {
+    // Still due - leave it where it is, in its place in any dispatch walk.
+    if (task->wheelSlot == WHEEL_SLOT_DUE && (task_stime_t)(task->runTime - current) < 0) {
+        return;
+    }
+    unlink(task);
+    file(task);
+}
+
+void TimerWheel::advance(task_time_t now) {
+    while (taskTimeReached(now, current)) {
+        uint8_t idx = current & TIMER_WHEEL_MASK;
+
+        // Level 0 has wrapped - pull the next slot of each higher level down,
+        // stopping at the first level that hasn't wrapped as well.
+        if (idx == 0) {
+            uint8_t l;
+            for (l = 1; l < TIMER_WHEEL_LEVELS; l++) {
+                int8_t li = levelIndex(current, l);
+                if (li < 0) {
+                    break;
+                }
+                cascade(l);
+                if (li != 0) {
+                    break;
+                }
+            }
+            // Every level has wrapped - re-file anything beyond the horizon.
+            if (l == TIMER_WHEEL_LEVELS && overflow) {
+                Task *tp = overflow;
+                overflow = 0;
+                while (tp) {
+                    Task *np = tp->next;
+                    file(static_cast<TimedTask *>(tp));
+                    tp = np;
+                }
+            }
+        }
+
+        // Move the tasks for this tick onto the due tasks.
+        if (occupied[0] & (1UL << idx)) {
+            Task *tp = slots[0][idx];
+            slots[0][idx] = 0;
+            occupied[0] &= ~(1UL << idx);
+            while (tp) {
+                Task *np = tp->next;
+                linkDue(tp);
+                tp = np;
+            }
+        }
+
+        // Skip straight to the next tick with anything to do.
+        current++;
+        task_time_t next = nextEvent();
+        current = taskTimeBefore(now, next) ? now + 1 : next;
+    }
+}
+
+task_time_t TimerWheel::nextExpiry(task_time_t now) {
+    if (!dueTasks.isEmpty()) {
+        return now;
+    }
+    if (count == 0) {
+        return now + TASK_TIME_HORIZON;
+    }
+    return nextEvent();
+}
+
+/*
+ * Find the first tick, from the current one on, on which a non-empty slot
+ * expires or is cascaded.  For each level that is the first slot boundary
+ * at or after the current tick whose slot is occupied.
+ */
+task_time_t TimerWheel::nextEvent() {
+    task_time_t best = TASK_TIME_HORIZON;
+    for (uint8_t l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        uint8_t shift = TIMER_WHEEL_SLOT_BITS * l;
+        if (shift >= TASK_TIME_BITS) {
+            break;
+        }
+        uint32_t occ = occupied[l];
+        if (!occ) {
+            continue;
+        }
+        task_time_t span = (task_time_t)1 << shift;
+        task_time_t base = (current + span - 1) & ~(span - 1);
+        uint8_t k = (base >> shift) & TIMER_WHEEL_MASK;
+        // Rotate the bitmap so slot k is bit 0.  Slots 0 to k - 1, which
+        // only come round after the level wraps, land just below bit
+        // TIMER_WHEEL_SLOTS, after the others in wrapped order.  Any bits
+        // pushed above that are copies of slots k and up, already seen
+        // lower down, so they never win.
+        uint32_t rot = k ? (occ >> k) | (occ << (TIMER_WHEEL_SLOTS - k)) : occ;
+        task_time_t gap = (base - current) + ((task_time_t)__builtin_ctzl(rot) << shift);
+        if (gap < best) {
+            best = gap;
+        }
+    }
+
+    // The overflow list is re-filed each time the top level wraps.
+#if TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS < TASK_TIME_BITS
+    if (overflow) {
+        task_time_t span = (task_time_t)1 << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS);
+        task_time_t gap = ((current + span - 1) & ~(span - 1)) - current;
+        if (gap < best) {
+            best = gap;
+        }
+    }
+#endif
+    return current + best;
+}
+
+void TimerWheel::link(Task **head, Task *task) {
+    task->prev = 0;
+    task->next = *head;
+    if (*head) {
+        (*head)->prev = task;
+    }
+    *head = task;
+}
+
+void TimerWheel::linkDue(Task *task) {
+    static_cast<TimedTask *>(task)->wheelSlot = WHEEL_SLOT_DUE;
+    dueTasks.link(task);
+}
+
+void TimerWheel::unlink(TimedTask *task) {
+    uint8_t slot = task->wheelSlot;
+    if (slot == WHEEL_SLOT_DUE) {
+        dueTasks.unlink(task);
+        return;
+    }
+    Task **head;
+    if (slot == WHEEL_SLOT_OVERFLOW) {
+        head = &overflow;
+    } else {
+        head = &slots[slot / TIMER_WHEEL_SLOTS][slot % TIMER_WHEEL_SLOTS];
+    }
+
+    if (task->prev) {
+        task->prev->next = task->next;
+    } else {
+        *head = task->next;
+    }
+    if (task->next) {
+        task->next->prev = task->prev;
+    }
+    task->next = task->prev = 0;
+
+    if (slot < WHEEL_SLOT_OVERFLOW && *head == 0) {
+        occupied[slot / TIMER_WHEEL_SLOTS] &= ~(1UL << (slot % TIMER_WHEEL_SLOTS));
+    }
+}
+
+void TimerWheel::file(TimedTask *task) {
+    task_time_t delta = task->runTime - current;
+
+    // Already due.
+    if ((task_stime_t)delta < 0) {
+        linkDue(task);
+        return;
+    }
+
+    // Pick the lowest level whose span covers the delay.
+    for (uint8_t l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        uint8_t shift = TIMER_WHEEL_SLOT_BITS * (l + 1);
+        if (shift >= TASK_TIME_BITS || (delta >> shift) == 0) {
+            uint8_t idx = levelIndex(task->runTime, l);
+            task->wheelSlot = l * TIMER_WHEEL_SLOTS + idx;
+            link(&slots[l][idx], task);
+            occupied[l] |= 1UL << idx;
+            return;
+        }
+    }
+
+    task->wheelSlot = WHEEL_SLOT_OVERFLOW;
+    link(&overflow, task);
+}
+
+void TimerWheel::cascade(uint8_t level) {
+    uint8_t idx = levelIndex(current, level);
+    Task *tp = slots[level][idx];
+    slots[level][idx] = 0;
+    occupied[level] &= ~(1UL << idx);
+    while (tp) {
+        Task *np = tp->next;
+        file(static_cast<TimedTask *>(tp));
+        tp = np;
+    }
+}
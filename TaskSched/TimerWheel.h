@@ -0,0 +1,105 @@
+/*
+ * Hierarchical timer wheel - an optional back end for dispatching TimedTasks.
+ */
+
+/*
+ * Rather than asking every TimedTask "can you run?" on every pass, the
+ * wheel files each task into a slot keyed on its runTime.  Level 0 has one
+ * slot per clock tick, each higher level has one slot per revolution of the
+ * level below it.  As the clock advances, slots in the higher levels are
+ * cascaded down, and level 0 slots that come due are moved onto the due
+ * tasks' ReadyBitmap, indexed by priority.  Ticks on which nothing happens
+ * are skipped using a per-level bitmap of occupied slots, so finding the
+ * due tasks is O(1) amortized per tick, regardless of how many tasks are
+ * waiting or how fine grained the clock is.
+ */
+
+#ifndef TimerWheel_h
+#define TimerWheel_h
+
+#include "Task.h"
+#include "ReadyBitmap.h"
+
+// log2 of the number of slots per level (at most 5, i.e. 32 slots).
+#ifndef TIMER_WHEEL_SLOT_BITS
+#define TIMER_WHEEL_SLOT_BITS 4
+#endif
+
+// Number of levels.  Tasks further into the future than the wheel can hold
+// are kept on an overflow list and re-filed once per top level revolution.
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS 8
+#endif
+
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+#if TIMER_WHEEL_SLOT_BITS > 5 || TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS > 0xFC
+#error "TimerWheel: too many slots"
+#endif
+
+class TimerWheel {
+
+public:
+    /*
+     * Create an empty timer wheel.
+     * now - current time, in clock ticks.
+     */
+    TimerWheel(task_time_t now = 0);
+
+    /*
+     * Add a task to the wheel, filed according to its runTime.
+     */
+    void add(TimedTask *task);
+
+    /*
+     * Take a task off the wheel.
+     */
+    void remove(TimedTask *task);
+
+    /*
+     * Re-file a task after its runTime has changed.
+     */
+    void reschedule(TimedTask *task);
+
+    /*
+     * Move every task whose runTime has been reached onto the due tasks.
+     * now - current time, in clock ticks.
+     */
+    void advance(task_time_t now);
+
+    /*
+     * Get the tasks that are due, to walk in priority order.
+     */
+    inline ReadyBitmap &due() { return dueTasks; }
+
+    /*
+     * Get the earliest time at which a task could next become due.  The
+     * answer is exact for tasks on level 0 and a lower bound otherwise.
+     * now - current time, in clock ticks.
+     * return - the time, or now if tasks are already due.
+     */
+    task_time_t nextExpiry(task_time_t now);
+
+    /*
+     * Is anything on the wheel at all?
+     */
+    inline bool isEmpty() { return count == 0; }
+
+private:
+    void link(Task **head, Task *task);
+    void linkDue(Task *task);
+    void unlink(TimedTask *task);
+    void file(TimedTask *task);
+    void cascade(uint8_t level);
+    task_time_t nextEvent();
+
+    task_time_t current;                                    // Next tick to process.
+    Task *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];     // Slot list heads.
+    uint32_t occupied[TIMER_WHEEL_LEVELS];                  // Bitmap of non-empty slots.
+    ReadyBitmap dueTasks;                                   // Due tasks, by priority.
+    Task *overflow;                                         // Tasks beyond the horizon.
+    task_count_t count;                                     // Tasks on the wheel.
+};
+
+#endif
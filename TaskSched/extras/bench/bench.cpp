@@ -0,0 +1,466 @@
+/*
+ * Host benchmark of scheduler dispatch overhead and jitter.
+ */
+
+/*
+ * Runs the scheduler against the virtual clock, one tick per step, so the
+ * workload is identical from run to run and machine to machine - only the
+ * cost of dispatching it varies.  On each step a share of the triggered
+ * tasks are made runnable, then dispatch() is called until nothing more can
+ * run.  Every dispatch() that runs a task is timed with CLOCK_MONOTONIC.
+ *
+ * For each scheduler mode, task count and mix of TimedTasks to
+ * TriggeredTasks it reports:
+ *
+ *   passes_per_sec   - dispatch() calls per second of wall time.
+ *   canrun_per_pass  - canRun() calls per dispatch().
+ *   lat_*_ns         - wall time of dispatch() calls that ran a task:
+ *                      percentiles, mean, max and standard deviation.
+ *   jitter_ns        - p99 minus p50 latency.
+ *
+ * as JSON (the default) or CSV, suitable for diffing against a baseline.
+ * Run with -h for the options.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "TaskScheduler.h"
+#include "StaticTaskScheduler.h"
+
+#if !defined(TASK_CLOCK_VIRTUAL)
+#error "The benchmark needs TASK_CLOCK_VIRTUAL"
+#endif
+
+// Most latency samples kept per configuration.
+#define MAX_SAMPLES 2000000
+
+// Range of TimedTask periods, and mean interval between triggers of any
+// one TriggeredTask, all in ticks.
+#define PERIOD_MIN 10
+#define PERIOD_MAX 1000
+#define TRIGGER_INTERVAL 500
+
+static uint64_t canRunCalls;    // canRun() calls, across all tasks.
+static uint64_t runCalls;       // run() calls, across all tasks.
+
+/*
+ * Small, fast, deterministic random number generator (xorshift64).
+ */
+#define RNG_SEED 88172645463325252ULL
+
+static uint64_t rngState = RNG_SEED;
+
+static inline uint32_t rng() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return (uint32_t)(rngState >> 32);
+}
+
+static inline uint64_t wallNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Task types, counting calls on the way through.
+ */
+class BenchTimed : public TimedTask {
+
+public:
+    BenchTimed(task_time_t when, task_time_t _period) : TimedTask(when), period(_period) {}
+
+    virtual bool canRun(task_time_t now) {
+        canRunCalls++;
+        return TimedTask::canRun(now);
+    }
+
+    virtual void run(task_time_t now) {
+        runCalls++;
+        incRunTime(period);
+    }
+
+private:
+    task_time_t period;
+};
+
+class BenchTriggered : public TriggeredTask {
+
+public:
+    virtual bool canRun(task_time_t now) {
+        canRunCalls++;
+        return TriggeredTask::canRun(now);
+    }
+
+    virtual void run(task_time_t now) {
+        runCalls++;
+        resetRunnable();
+    }
+};
+
+/*
+ * Either sort of task, without virtual methods, for StaticTaskScheduler.
+ */
+class BenchStatic {
+
+public:
+    BenchStatic() : timed(false), runFlag(false), runTime(0), period(0) {}
+
+    inline bool canRun(task_time_t now) {
+        canRunCalls++;
+        return timed ? taskTimeReached(now, runTime) : runFlag;
+    }
+
+    inline void run(task_time_t now) {
+        runCalls++;
+        if (timed) {
+            runTime += period;
+        } else {
+            runFlag = false;
+        }
+    }
+
+    bool timed;
+    bool runFlag;
+    task_time_t runTime;
+    task_time_t period;
+};
+
+enum Mode { MODE_SCAN, MODE_WHEEL, MODE_STATIC, MODE_TABLE, NUM_MODES };
+static const char *modeNames[] = { "scan", "wheel", "static", "table" };
+
+// Task count StaticTaskScheduler is instantiated for.
+#define STATIC_TASKS 5
+
+struct Result {
+    Mode mode;
+    uint32_t tasks;
+    uint32_t timedPct;
+    uint64_t steps;
+    uint64_t passes;
+    uint64_t runs;
+    double seconds;
+    double passesPerSec;
+    double canRunPerPass;
+    double latMean;
+    double latStddev;
+    uint64_t latP50;
+    uint64_t latP90;
+    uint64_t latP99;
+    uint64_t latP999;
+    uint64_t latMax;
+};
+
+/*
+ * Is task i of n a TimedTask?  Spreads the TimedTasks evenly through the
+ * priority order.
+ */
+static inline bool isTimed(uint32_t i, uint32_t pct) {
+    return (i + 1) * pct / 100 != i * pct / 100;
+}
+
+static inline task_time_t randomPeriod() {
+    return PERIOD_MIN + rng() % (PERIOD_MAX - PERIOD_MIN + 1);
+}
+
+/*
+ * Drive any scheduler with dispatch(now) through the workload, for at most
+ * maxSteps ticks or budget seconds.  trigger(i) makes triggered task i runnable.
+ */
+template <typename Sched, typename Trigger>
+static void drive(Sched &sched, uint32_t numTriggered, Trigger trigger,
+  uint64_t maxSteps, double budget, std::vector<uint32_t> &samples, Result &r) {
+    uint64_t budgetNs = (uint64_t)(budget * 1e9);
+    uint64_t triggerAcc = 0;
+    canRunCalls = 0;
+    runCalls = 0;
+    r.steps = 0;
+    r.passes = 0;
+    samples.clear();
+
+    uint64_t start = wallNs();
+    uint64_t elapsed = 0;
+    task_time_t now = 0;
+    while (r.steps < maxSteps && elapsed < budgetNs) {
+        taskClockSet(++now);
+        triggerAcc += numTriggered;
+        while (triggerAcc >= TRIGGER_INTERVAL) {
+            trigger(rng() % numTriggered);
+            triggerAcc -= TRIGGER_INTERVAL;
+        }
+        while (1) {
+            uint64_t t0 = wallNs();
+            bool ran = sched.dispatch(now);
+            uint64_t t1 = wallNs();
+            r.passes++;
+            if (!ran) {
+                break;
+            }
+            if (samples.size() < MAX_SAMPLES) {
+                samples.push_back((uint32_t)(t1 - t0));
+            }
+        }
+        r.steps++;
+        elapsed = wallNs() - start;
+    }
+    r.seconds = elapsed / 1e9;
+    r.runs = runCalls;
+    r.passesPerSec = r.passes / r.seconds;
+    r.canRunPerPass = r.passes ? (double)canRunCalls / r.passes : 0;
+}
+
+static void summarize(std::vector<uint32_t> &samples, Result &r) {
+    r.latMean = r.latStddev = 0;
+    r.latP50 = r.latP90 = r.latP99 = r.latP999 = r.latMax = 0;
+    size_t n = samples.size();
+    if (n == 0) {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0, sumSq = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += samples[i];
+        sumSq += (double)samples[i] * samples[i];
+    }
+    r.latMean = sum / n;
+    r.latStddev = sqrt(std::max(0.0, sumSq / n - r.latMean * r.latMean));
+    r.latP50 = samples[n * 50 / 100];
+    r.latP90 = samples[n * 90 / 100];
+    r.latP99 = samples[n * 99 / 100];
+    r.latP999 = samples[n * 999 / 1000];
+    r.latMax = samples[n - 1];
+}
+
+static bool runArray(Mode mode, uint32_t n, uint32_t pct, uint64_t maxSteps,
+  double budget, std::vector<uint32_t> &samples, Result &r) {
+    // Reserved up front, so the tasks never move.
+    std::vector<Task *> tasks(n);
+    std::vector<BenchTimed> timed;
+    std::vector<BenchTriggered> triggered;
+    timed.reserve(n);
+    triggered.reserve(n);
+    rngState = RNG_SEED;
+    for (uint32_t i = 0; i < n; i++) {
+        if (isTimed(i, pct)) {
+            task_time_t period = randomPeriod();
+            timed.push_back(BenchTimed(1 + rng() % period, period));
+            tasks[i] = &timed.back();
+        } else {
+            triggered.push_back(BenchTriggered());
+            tasks[i] = &triggered.back();
+        }
+    }
+
+    taskClockSet(0);
+    TimerWheel wheel(0);
+    TaskScheduler sched(&tasks[0], n, mode == MODE_WHEEL ? &wheel : 0);
+#if defined(TASK_DEADLINE_TABLE)
+    std::vector<task_time_t> times(n);
+    std::vector<task_count_t> priorities(n);
+    std::vector<TimedTask *> entries(n);
+    DeadlineTable table(&times[0], &priorities[0], &entries[0], n);
+    if (mode == MODE_TABLE) {
+        sched.setDeadlineTable(&table);
+    }
+#else
+    if (mode == MODE_TABLE) {
+        return false;
+    }
+#endif
+    uint32_t nt = triggered.size();
+    drive(sched, nt, [&](uint32_t i) { triggered[i].setRunnable(); },
+      maxSteps, budget, samples, r);
+    return true;
+}
+
+static bool runStatic(uint32_t n, uint32_t pct, uint64_t maxSteps,
+  double budget, std::vector<uint32_t> &samples, Result &r) {
+    if (n != STATIC_TASKS) {
+        return false;
+    }
+    StaticTaskScheduler<BenchStatic, BenchStatic, BenchStatic, BenchStatic, BenchStatic> sched;
+    BenchStatic *t[STATIC_TASKS] = {
+        &sched.get<0>(), &sched.get<1>(), &sched.get<2>(), &sched.get<3>(), &sched.get<4>()
+    };
+    std::vector<BenchStatic *> triggered;
+    rngState = RNG_SEED;
+    for (uint32_t i = 0; i < STATIC_TASKS; i++) {
+        t[i]->timed = isTimed(i, pct);
+        if (t[i]->timed) {
+            t[i]->period = randomPeriod();
+            t[i]->runTime = 1 + rng() % t[i]->period;
+        } else {
+            triggered.push_back(t[i]);
+        }
+    }
+
+    taskClockSet(0);
+    uint32_t nt = triggered.size();
+    drive(sched, nt, [&](uint32_t i) { triggered[i]->runFlag = true; },
+      maxSteps, budget, samples, r);
+    return true;
+}
+
+/*
+ * Parse a comma separated list of numbers.
+ */
+static std::vector<uint32_t> parseList(const char *s) {
+    std::vector<uint32_t> v;
+    while (*s) {
+        char *end;
+        v.push_back(strtoul(s, &end, 10));
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            break;
+        }
+    }
+    return v;
+}
+
+/*
+ * Cost of one timestamp, to be read against the latency figures.
+ */
+static double timerOverhead() {
+    const int n = 1000000;
+    uint64_t start = wallNs();
+    for (int i = 0; i < n; i++) {
+        wallNs();
+    }
+    return (double)(wallNs() - start) / n;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+      "usage: %s [-n counts] [-m timed%%s] [-M modes] [-s steps] [-t secs] [-f json|csv] [-o file]\n"
+      "  -n  task counts, default 5,50,500,5000,50000,100000\n"
+      "  -m  percentages of TimedTasks, default 100,80,50,0\n"
+      "  -M  modes, any of scan,wheel,static,table, default all - table needs\n"
+      "      a TASK_DEADLINE_TABLE build\n"
+      "  -s  most clock ticks per configuration, default 100000\n"
+      "  -t  most seconds per configuration, default 0.5\n"
+      "  -f  output format, default json\n"
+      "  -o  output file, default stdout\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    std::vector<uint32_t> counts = parseList("5,50,500,5000,50000,100000");
+    std::vector<uint32_t> mixes = parseList("100,80,50,0");
+    bool modes[NUM_MODES] = { true, true, true, true };
+    uint64_t maxSteps = 100000;
+    double budget = 0.5;
+    bool csv = false;
+    FILE *out = stdout;
+
+    for (int a = 1; a < argc; a++) {
+        if (argv[a][0] != '-' || argv[a][1] == '\0' || argv[a][2] != '\0' || a + 1 >= argc) {
+            usage(argv[0]);
+        }
+        const char *arg = argv[++a];
+        switch (argv[a - 1][1]) {
+        case 'n':
+            counts = parseList(arg);
+            break;
+        case 'm':
+            mixes = parseList(arg);
+            break;
+        case 'M':
+            for (int m = 0; m < NUM_MODES; m++) {
+                modes[m] = strstr(arg, modeNames[m]) != 0;
+            }
+            break;
+        case 's':
+            maxSteps = strtoull(arg, 0, 10);
+            break;
+        case 't':
+            budget = atof(arg);
+            break;
+        case 'f':
+            csv = strcmp(arg, "csv") == 0;
+            break;
+        case 'o':
+            if ((out = fopen(arg, "w")) == 0) {
+                perror(arg);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    double overhead = timerOverhead();
+    if (csv) {
+        fprintf(out, "mode,tasks,timed_pct,steps,passes,runs,seconds,passes_per_sec,"
+          "canrun_per_pass,lat_mean_ns,lat_stddev_ns,lat_p50_ns,lat_p90_ns,"
+          "lat_p99_ns,lat_p999_ns,lat_max_ns,jitter_ns\n");
+    } else {
+        fprintf(out, "{\n  \"clock_overhead_ns\": %.1f,\n  \"results\": [", overhead);
+    }
+
+    std::vector<uint32_t> samples;
+    samples.reserve(MAX_SAMPLES);
+    bool first = true;
+    for (size_t c = 0; c < counts.size(); c++) {
+        for (size_t x = 0; x < mixes.size(); x++) {
+            for (int m = 0; m < NUM_MODES; m++) {
+                uint32_t n = counts[c];
+                uint32_t pct = std::min(mixes[x], 100u);
+                if (!modes[m] || n == 0) {
+                    continue;
+                }
+                Result r;
+                r.mode = (Mode)m;
+                r.tasks = n;
+                r.timedPct = pct;
+                bool ok = m == MODE_STATIC
+                  ? runStatic(n, pct, maxSteps, budget, samples, r)
+                  : runArray((Mode)m, n, pct, maxSteps, budget, samples, r);
+                if (!ok) {
+                    continue;
+                }
+                summarize(samples, r);
+                fprintf(stderr, "%-6s %6u tasks %3u%% timed: %12.0f passes/s, %10.2f canRun/pass, p99 %llu ns\n",
+                  modeNames[m], n, pct, r.passesPerSec, r.canRunPerPass, (unsigned long long)r.latP99);
+
+                if (csv) {
+                    fprintf(out, "%s,%u,%u,%llu,%llu,%llu,%.6f,%.1f,%.3f,%.1f,%.1f,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                      modeNames[m], n, pct, (unsigned long long)r.steps,
+                      (unsigned long long)r.passes, (unsigned long long)r.runs,
+                      r.seconds, r.passesPerSec, r.canRunPerPass, r.latMean, r.latStddev,
+                      (unsigned long long)r.latP50, (unsigned long long)r.latP90,
+                      (unsigned long long)r.latP99, (unsigned long long)r.latP999,
+                      (unsigned long long)r.latMax, (unsigned long long)(r.latP99 - r.latP50));
+                } else {
+                    fprintf(out, "%s\n    {\"mode\": \"%s\", \"tasks\": %u, \"timed_pct\": %u, "
+                      "\"steps\": %llu, \"passes\": %llu, \"runs\": %llu, \"seconds\": %.6f, "
+                      "\"passes_per_sec\": %.1f, \"canrun_per_pass\": %.3f, "
+                      "\"lat_mean_ns\": %.1f, \"lat_stddev_ns\": %.1f, \"lat_p50_ns\": %llu, "
+                      "\"lat_p90_ns\": %llu, \"lat_p99_ns\": %llu, \"lat_p999_ns\": %llu, "
+                      "\"lat_max_ns\": %llu, \"jitter_ns\": %llu}",
+                      first ? "" : ",", modeNames[m], n, pct, (unsigned long long)r.steps,
+                      (unsigned long long)r.passes, (unsigned long long)r.runs,
+                      r.seconds, r.passesPerSec, r.canRunPerPass, r.latMean, r.latStddev,
+                      (unsigned long long)r.latP50, (unsigned long long)r.latP90,
+                      (unsigned long long)r.latP99, (unsigned long long)r.latP999,
+                      (unsigned long long)r.latMax, (unsigned long long)(r.latP99 - r.latP50));
+                }
+                fflush(out);
+                first = false;
+            }
+        }
+    }
+    if (!csv) {
+        fprintf(out, "\n  ]\n}\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,1860 @@
+/*
+ * Host tests of the scheduler's building blocks and dispatch rules.
+ */
+
+/*
+ * Built against the virtual clock, so every test sets the time it needs
+ * and the results are the same on every run and every machine.  Each test
+ * is a function making CHECK()s; a failed check is reported with its line
+ * and the test carries on.  Run with no arguments for every test, or with
+ * test names to run just those.  Exits non-zero if any check failed.
+ *
+ * Extra configuration can be tested by rebuilding the library with it,
+ * e.g. "make clean run CPPFLAGS=-DTASK_TIME_64".  The coroutine tests need
+ * C++20 - "make run-cxx20".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <string>
+#include <vector>
+#include "TaskScheduler.h"
+#include "TaskSim.h"
+#include "Channel.h"
+#include "EventGroup.h"
+#include "Debugger.h"
+#include "StaticTaskScheduler.h"
+#include "ThreadedTaskScheduler.h"
+#include "TaskBudget.h"
+#include "TaskFd.h"
+#include "TaskGroup.h"
+#include "TaskCoroutine.h"
+#include "TaskPreempt.h"
+
+#if !defined(TASK_CLOCK_VIRTUAL)
+#error "The tests need TASK_CLOCK_VIRTUAL"
+#endif
+
+static const char *testName;    // Test being run.
+static unsigned checks;         // Checks made, across all tests.
+static unsigned failures;       // Checks that failed.
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char *what, int line) {
+    checks++;
+    if (!ok) {
+        failures++;
+        fprintf(stderr, "tests.cpp:%d: %s: %s\n", line, testName, what);
+    }
+}
+
+/*
+ * Deterministic random number generator (xorshift32).
+ */
+static uint32_t rngState;
+
+static inline uint32_t rng() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+/*
+ * Real time, in nanoseconds, for tests that wait on the host.
+ */
+static uint64_t wallNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Task types.  Each counts its runs; the ones used on their own, off a
+ * scheduler, set their priority directly.
+ */
+class TestTask : public Task {
+
+public:
+    TestTask(task_count_t p = 0) : runs(0) { priority = p; }
+    virtual bool canRun(task_time_t now) { return false; }
+    virtual void run(task_time_t now) { runs++; }
+
+    unsigned runs;
+};
+
+class TestTimed : public TimedTask {
+
+public:
+    TestTimed(task_time_t when = 0, task_count_t p = 0) : TimedTask(when), runs(0) {
+        priority = p;
+    }
+    virtual void run(task_time_t now) { runs++; }
+
+    unsigned runs;
+};
+
+class TestTriggered : public TriggeredTask {
+
+public:
+    TestTriggered() : runs(0), order(0), log(0), victim(0), sched(0) {}
+
+    virtual void run(task_time_t now) {
+        resetRunnable();
+        runs++;
+        if (log) {
+            log->push_back(order);
+        }
+        if (victim) {
+            sched->remove(*victim);
+        }
+    }
+
+    unsigned runs;
+    int order;                  // Logged to log on each run, if set.
+    std::vector<int> *log;
+    Task *victim;               // Removed from sched on each run, if set.
+    TaskScheduler *sched;
+};
+
+/*
+ * Timer wheel: tasks filed at the edges of every level, and either side of
+ * the clock wrapping, come due on exactly their run time, whether the
+ * wheel is stepped a tick at a time or jumped from one nextExpiry() to the
+ * next.
+ */
+
+// Time at which each wheel test starts: zero, just short of a level 0 and
+// a level 2 boundary, and just before the clock and its sign bit wrap.
+static const task_time_t wheelStarts[] = {
+    0,
+    TIMER_WHEEL_SLOTS - 3,
+    ((task_time_t)1 << (3 * TIMER_WHEEL_SLOT_BITS)) - 5,
+    (task_time_t)0 - 100,
+    ((task_time_t)1 << (TASK_TIME_BITS - 1)) - 100
+};
+#define NUM_STARTS (sizeof(wheelStarts) / sizeof(wheelStarts[0]))
+
+// Longest delay tested.  Past the top level, tasks wait on the overflow
+// list to be re-filed once a revolution, so keep to a few revolutions.
+#if TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS + 4 < TASK_TIME_BITS - 1
+#define MAX_DELAY ((task_time_t)1 << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS + 4))
+#else
+#define MAX_DELAY TASK_TIME_HORIZON
+#endif
+
+/*
+ * Delays either side of the span of each level, and of the whole wheel.
+ */
+static std::vector<task_time_t> boundaryDelays() {
+    std::vector<task_time_t> delays;
+    for (uint8_t l = 0; l <= TIMER_WHEEL_LEVELS; l++) {
+        uint8_t shift = TIMER_WHEEL_SLOT_BITS * l;
+        if (shift >= TASK_TIME_BITS - 1) {
+            break;
+        }
+        task_time_t span = (task_time_t)1 << shift;
+        for (task_time_t d = span - 1; d <= span + 1; d++) {
+            if (d < MAX_DELAY) {
+                delays.push_back(d);
+            }
+        }
+    }
+    delays.push_back(MAX_DELAY - 1);
+    return delays;
+}
+
+/*
+ * Run the wheel until every task has come due, jumping from each
+ * nextExpiry() to the next, and check each comes due exactly on time.
+ */
+static void drainWheel(TimerWheel &wheel, task_time_t now, std::vector<TestTimed> &tasks) {
+    unsigned left = tasks.size();
+    unsigned steps = 0;
+    while (left && steps++ < 100000) {
+        wheel.advance(now);
+        ReadyBitmap &due = wheel.due();
+        for (Task *tp = due.first(); tp; ) {
+            Task *np = due.next(tp);
+            TestTimed *ttp = static_cast<TestTimed *>(tp);
+            CHECK(ttp->getRunTime() == now);
+            CHECK(ttp->runs == 0);
+            ttp->runs++;
+            wheel.remove(ttp);
+            left--;
+            tp = np;
+        }
+        if (!left) {
+            break;
+        }
+
+        // nextExpiry() may be early, but never late.
+        task_time_t next = wheel.nextExpiry(now);
+        CHECK(taskTimeBefore(now, next));
+        for (size_t i = 0; i < tasks.size(); i++) {
+            if (!tasks[i].runs) {
+                CHECK(!taskTimeBefore(tasks[i].getRunTime(), next));
+            }
+        }
+        now = next;
+    }
+    CHECK(left == 0);
+    CHECK(wheel.isEmpty());
+}
+
+static void testWheelBoundaries() {
+    std::vector<task_time_t> delays = boundaryDelays();
+    for (size_t s = 0; s < NUM_STARTS; s++) {
+        task_time_t start = wheelStarts[s];
+        TimerWheel wheel(start);
+        std::vector<TestTimed> tasks;
+        for (size_t i = 0; i < delays.size(); i++) {
+            tasks.push_back(TestTimed(start + delays[i], i));
+        }
+        for (size_t i = 0; i < tasks.size(); i++) {
+            wheel.add(&tasks[i]);
+        }
+        drainWheel(wheel, start, tasks);
+    }
+}
+
+static void testWheelSingle() {
+    // On its own, so nothing else on the wheel hides a slot that is only
+    // reached once its level wraps.
+    std::vector<task_time_t> delays = boundaryDelays();
+    for (task_time_t d = 0; d < 3 * TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS; d++) {
+        delays.push_back(d);
+    }
+    for (size_t s = 0; s < NUM_STARTS; s++) {
+        task_time_t start = wheelStarts[s];
+        for (size_t i = 0; i < delays.size(); i++) {
+            TimerWheel wheel(start);
+            std::vector<TestTimed> tasks(1, TestTimed(start + delays[i]));
+            wheel.add(&tasks[0]);
+            drainWheel(wheel, start, tasks);
+        }
+    }
+}
+
+static void testWheelRandom() {
+    rngState = 2463534242UL;
+    for (size_t s = 0; s < NUM_STARTS; s++) {
+        task_time_t start = wheelStarts[s];
+        TimerWheel wheel(start);
+        std::vector<TestTimed> tasks;
+        for (unsigned i = 0; i < 500; i++) {
+            // Delays spread over every level.
+            task_time_t delay = (rng() >> (rng() % 32)) % MAX_DELAY;
+            tasks.push_back(TestTimed(start + delay, i % 64));
+        }
+        for (size_t i = 0; i < tasks.size(); i++) {
+            wheel.add(&tasks[i]);
+        }
+        // Move some tasks once filed, so they leave one slot for another.
+        for (size_t i = 0; i < tasks.size(); i += 7) {
+            tasks[i].setRunTime(start + (rng() & 0xFFFF));
+        }
+        drainWheel(wheel, start, tasks);
+    }
+}
+
+static void testWheelStepping() {
+    // One tick at a time across the wrap, with something due on every
+    // other tick and several sharing one.
+    for (size_t s = 0; s < NUM_STARTS; s++) {
+        task_time_t start = wheelStarts[s];
+        TimerWheel wheel(start);
+        std::vector<TestTimed> tasks;
+        for (unsigned i = 0; i < 300; i++) {
+            tasks.push_back(TestTimed(start + (i * 2) % 400, i % 8));
+        }
+        for (size_t i = 0; i < tasks.size(); i++) {
+            wheel.add(&tasks[i]);
+        }
+        unsigned seen = 0;
+        for (task_time_t d = 0; d < 400; d++) {
+            task_time_t now = start + d;
+            wheel.advance(now);
+            unsigned dueNow = 0;
+            ReadyBitmap &due = wheel.due();
+            while (Task *tp = due.first()) {
+                CHECK(static_cast<TestTimed *>(tp)->getRunTime() == now);
+                wheel.remove(static_cast<TestTimed *>(tp));
+                dueNow++;
+            }
+            unsigned expected = 0;
+            for (size_t i = 0; i < tasks.size(); i++) {
+                expected += tasks[i].getRunTime() == now;
+            }
+            CHECK(dueNow == expected);
+            seen += dueNow;
+        }
+        CHECK(seen == tasks.size());
+    }
+}
+
+/*
+ * ReadyBitmap: walked in priority order across word boundaries, with the
+ * lowest level taking every priority past it, and the cursor stepping
+ * over a task unlinked from under it.
+ */
+static void testReadyBitmap() {
+    static const task_count_t prios[] = {
+        TASK_READY_LEVELS + 5, 0, 31, 32, 33, 64, 100, 100, TASK_READY_LEVELS - 1, 1
+    };
+    const unsigned n = sizeof(prios) / sizeof(prios[0]);
+    std::vector<TestTask> tasks;
+    for (unsigned i = 0; i < n; i++) {
+        tasks.push_back(TestTask(prios[i]));
+    }
+    ReadyBitmap map;
+    CHECK(map.isEmpty());
+    CHECK(map.first() == 0);
+    for (unsigned i = 0; i < n; i++) {
+        map.link(&tasks[i]);
+    }
+    CHECK(!map.isEmpty());
+
+    // Every task once, in priority order.
+    unsigned count = 0;
+    task_count_t last = 0;
+    for (Task *tp = map.first(); tp; tp = map.next(tp)) {
+        CHECK(tp->getPriority() >= last);
+        last = tp->getPriority();
+        count++;
+    }
+    CHECK(count == n);
+    CHECK(map.first(2)->getPriority() == 31);
+    CHECK(map.first(33)->getPriority() == 33);
+    CHECK(map.first(34)->getPriority() == 64);
+    CHECK(map.first(TASK_READY_LEVELS - 1) != 0);
+
+    // Unlinking the task under the cursor moves the cursor on.
+    Task *at32 = map.first(32);
+    Task *at33 = map.next(at32);
+    map.setCursor(at32);
+    map.unlink(at32);
+    CHECK(map.getCursor() == at33);
+    map.unlink(&tasks[0]);
+    CHECK(map.getCursor() == at33);
+    map.setCursor(0);
+
+    while (Task *tp = map.first()) {
+        map.unlink(tp);
+    }
+    CHECK(map.isEmpty());
+}
+
+/*
+ * ReadyQueue: first in, first out, reusable once popped, and from several
+ * producer threads at once nothing lost, duplicated or reordered per
+ * producer.
+ */
+struct QueueItem : public ReadyLink {
+    unsigned producer;
+    unsigned seq;
+};
+
+static void testReadyQueue() {
+    ReadyQueue q;
+    QueueItem items[3];
+    CHECK(q.pop() == 0);
+    for (int round = 0; round < 2; round++) {
+        for (unsigned i = 0; i < 3; i++) {
+            q.push(&items[i]);
+        }
+        for (unsigned i = 0; i < 3; i++) {
+            CHECK(q.pop() == &items[i]);
+        }
+        CHECK(q.pop() == 0);
+    }
+
+    const unsigned PRODUCERS = 4;
+    const unsigned PER_PRODUCER = 20000;
+    std::vector<QueueItem> pool(PRODUCERS * PER_PRODUCER);
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < PRODUCERS; p++) {
+        threads.push_back(std::thread([&q, &pool, p, PER_PRODUCER]() {
+            for (unsigned i = 0; i < PER_PRODUCER; i++) {
+                QueueItem &item = pool[p * PER_PRODUCER + i];
+                item.producer = p;
+                item.seq = i;
+                q.push(&item);
+                if (i % 64 == 0) {
+                    sched_yield();
+                }
+            }
+        }));
+    }
+    std::vector<unsigned> nextSeq(PRODUCERS, 0);
+    unsigned popped = 0;
+    bool inOrder = true;
+    while (popped < pool.size()) {
+        QueueItem *item = static_cast<QueueItem *>(q.pop());
+        if (!item) {
+            sched_yield();
+            continue;
+        }
+        inOrder = inOrder && item->seq == nextSeq[item->producer];
+        nextSeq[item->producer] = item->seq + 1;
+        popped++;
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    CHECK(inOrder);
+    CHECK(q.pop() == 0);
+    for (unsigned p = 0; p < PRODUCERS; p++) {
+        CHECK(nextSeq[p] == PER_PRODUCER);
+    }
+}
+
+/*
+ * PeriodicTask overrun policies.  Each tick() costs a set number of ticks
+ * of the virtual clock.
+ */
+class TestPeriodic : public PeriodicTask {
+
+public:
+    TestPeriodic(OverrunPolicy policy, uint8_t maxCatchUp = 1) :
+      PeriodicTask(0, 10, policy, maxCatchUp), cost(0), runs(0) {}
+
+    virtual void tick(task_time_t now) {
+        taskClockSet(now + cost);
+        runs++;
+    }
+
+    /*
+     * Run the task at the current time with the given cost.
+     */
+    void runAt(task_time_t now, task_time_t _cost) {
+        taskClockSet(now);
+        cost = _cost;
+        run(now);
+    }
+
+    task_time_t cost;
+    unsigned runs;
+};
+
+static void testOverrunPolicies() {
+    // Finishing just as the next slot falls due is on time.
+    TestPeriodic exact(PeriodicTask::OVERRUN_SKIP);
+    exact.runAt(0, 10);
+    CHECK(exact.getRunTime() == 10);
+    CHECK(exact.getOverruns() == 0);
+    CHECK(exact.getSkipped() == 0);
+
+    // Finishing at 25 misses the slots at 10 and 20.
+    TestPeriodic skip(PeriodicTask::OVERRUN_SKIP);
+    skip.runAt(0, 25);
+    CHECK(skip.getRunTime() == 30);
+    CHECK(skip.getOverruns() == 1);
+    CHECK(skip.getSkipped() == 2);
+
+    TestPeriodic realign(PeriodicTask::OVERRUN_REALIGN);
+    realign.runAt(0, 25);
+    CHECK(realign.getRunTime() == 35);
+    CHECK(realign.getOverruns() == 1);
+    CHECK(realign.getSkipped() == 2);
+
+    // Make up one of the two, drop the other.
+    TestPeriodic one(PeriodicTask::OVERRUN_CATCH_UP, 1);
+    one.runAt(0, 25);
+    CHECK(one.getRunTime() == 20);
+    CHECK(one.getSkipped() == 1);
+    one.runAt(25, 0);
+    CHECK(one.getRunTime() == 30);
+    CHECK(one.getOverruns() == 1);
+
+    // Make up all three missed by finishing at 35, back to back, with the
+    // overrun counted once.
+    TestPeriodic all(PeriodicTask::OVERRUN_CATCH_UP, 3);
+    all.runAt(0, 35);
+    CHECK(all.getRunTime() == 10);
+    while (taskTimeBefore(all.getRunTime(), 35)) {
+        all.runAt(35, 0);
+    }
+    CHECK(all.runs == 4);
+    CHECK(all.getRunTime() == 40);
+    CHECK(all.getOverruns() == 1);
+    CHECK(all.getSkipped() == 0);
+
+    // A fresh overrun after catching up is counted again.
+    all.runAt(40, 15);
+    CHECK(all.getOverruns() == 2);
+}
+
+/*
+ * Channel: fills up, refuses and counts sends when full, stays in order
+ * across the ring wrapping, and triggers the consumer on each send and a
+ * bound producer only on the first release after a failed send.
+ */
+static void testChannel() {
+    Channel<int, 4> ch;
+    TestTriggered consumer, producer;
+    ch.bind(consumer);
+    ch.bindProducer(producer);
+    int v;
+    CHECK(ch.isEmpty());
+    CHECK(ch.peek() == 0);
+    CHECK(!ch.receive(v));
+
+    for (int i = 0; i < 4; i++) {
+        CHECK(ch.send(i));
+    }
+    CHECK(consumer.canRun(0));
+    CHECK(ch.getCount() == 4);
+    CHECK(!ch.canSend());
+    CHECK(ch.reserve() == 0);
+    CHECK(!ch.send(4));
+    CHECK(ch.getRejected() == 2);
+    CHECK(!producer.canRun(0));
+
+    // The first release after the failures triggers the producer, once.
+    CHECK(ch.receive(v) && v == 0);
+    CHECK(producer.canRun(0));
+    producer.resetRunnable();
+    CHECK(ch.receive(v) && v == 1);
+    CHECK(!producer.canRun(0));
+
+    // Round the ring many times, in order.
+    int sent = 4, received = 2;
+    for (int round = 0; round < 1000; round++) {
+        while (ch.send(sent)) {
+            sent++;
+        }
+        while (ch.receive(v)) {
+            CHECK(v == received);
+            received++;
+        }
+    }
+    CHECK(sent == received);
+    CHECK(ch.getRejected() == 2 + 1000);
+}
+
+/*
+ * Tasks of equal priority under DISPATCH_ALL_READY: every one runs once
+ * per pass, and a task removing another that has yet to run - or itself -
+ * doesn't end the walk.
+ */
+static void testEqualPriorities() {
+    for (int mode = 0; mode < 2; mode++) {
+        TimerWheel wheel(0);
+        TaskScheduler sched(mode ? &wheel : 0);
+        sched.setPolicy(TaskScheduler::DISPATCH_ALL_READY);
+        std::vector<int> log;
+        TestTriggered tasks[6];
+        TestTimed timed[3];
+        for (int i = 0; i < 6; i++) {
+            tasks[i].order = i;
+            tasks[i].log = &log;
+            tasks[i].sched = &sched;
+            sched.add(tasks[i], i < 4 ? 1 : 2);
+        }
+        for (int i = 0; i < 3; i++) {
+            sched.add(timed[i], 1);
+        }
+
+        taskClockSet(0);
+        for (int i = 0; i < 6; i++) {
+            tasks[i].setRunnable();
+        }
+        CHECK(sched.dispatch(0));
+        CHECK(log.size() == 6);
+        for (int i = 0; i < 3; i++) {
+            CHECK(timed[i].runs == 1);
+            timed[i].setRunTime(1000);
+        }
+        for (size_t i = 0; i < log.size(); i++) {
+            CHECK((log[i] < 4) == (i < 4));
+        }
+        CHECK(!sched.dispatch(0));
+
+        // Removing the rest of a priority - and the remover itself - from
+        // within the walk still leaves the lower priority to run.
+        log.clear();
+        for (int i = 0; i < 6; i++) {
+            tasks[i].setRunnable();
+        }
+        tasks[0].victim = &tasks[0];
+        tasks[1].victim = &tasks[4];
+        CHECK(sched.dispatch(0));
+        CHECK(tasks[0].runs == 2);
+        CHECK(tasks[4].runs == 1);
+        CHECK(tasks[5].runs == 2);
+        CHECK(log.size() == 5);
+    }
+}
+
+/*
+ * Under DISPATCH_PRIORITY, tasks of equal priority take one pass each.
+ */
+static void testEqualPrioritiesOnePerPass() {
+    TaskScheduler sched;
+    TestTriggered tasks[3];
+    for (int i = 0; i < 3; i++) {
+        sched.add(tasks[i], 5);
+        tasks[i].setRunnable();
+    }
+    CHECK(sched.dispatch(0));
+    CHECK(tasks[0].runs + tasks[1].runs + tasks[2].runs == 1);
+    CHECK(sched.dispatch(0));
+    CHECK(sched.dispatch(0));
+    CHECK(!sched.dispatch(0));
+    for (int i = 0; i < 3; i++) {
+        CHECK(tasks[i].runs == 1);
+    }
+}
+
+/*
+ * EventGroup: a publish makes the matching subscribers runnable through
+ * the ready queue, a clearOnRun subscriber takes the bits from the ones
+ * behind it, a subscriber made after its bits were published still runs,
+ * and subscribers come and go while another thread publishes.
+ */
+class TestEvent : public EventTask {
+
+public:
+    TestEvent(EventGroup &group, task_events_t mask, WaitMode mode = WAIT_ANY,
+      bool clearOnRun = false) :
+      EventTask(group, mask, mode, clearOnRun), runs(0), bits(0) {}
+
+    virtual void handle(task_time_t now, task_events_t _bits) {
+        runs++;
+        bits = _bits;
+    }
+
+    unsigned runs;
+    task_events_t bits;
+};
+
+static void testEventGroup() {
+    for (int mode = 0; mode < 2; mode++) {
+        EventGroup group;
+        TestEvent any(group, 0x3);
+        TestEvent all(group, 0x3, EventTask::WAIT_ALL);
+        TestEvent taker(group, 0x4, EventTask::WAIT_ANY, true);
+        TestEvent late(group, 0x4);
+        TimerWheel wheel(0);
+        TaskScheduler sched(mode ? &wheel : 0);
+        sched.add(any, 0);
+        sched.add(all, 1);
+        sched.add(taker, 2);
+        sched.add(late, 3);
+        sched.setPolicy(TaskScheduler::DISPATCH_ALL_READY);
+
+        CHECK(!sched.dispatch(0));
+        group.publish(0x1);
+        CHECK(sched.dispatch(0));
+        CHECK(any.runs == 1 && any.bits == 0x1);
+        CHECK(all.runs == 0);
+        group.publish(0x2);
+        CHECK(sched.dispatch(0));
+        CHECK(any.runs == 2 && all.runs == 1 && all.bits == 0x3);
+        CHECK(!sched.dispatch(0));
+
+        group.publish(0x4);
+        sched.dispatch(0);
+        CHECK(taker.runs == 1);
+        CHECK(late.runs == 0);
+        CHECK(group.getBits() == 0x3);
+
+        TestEvent after(group, 0x2);
+        sched.add(after, 4);
+        CHECK(sched.dispatch(0));
+        CHECK(after.runs == 1 && after.bits == 0x2);
+        sched.remove(after);
+    }
+
+    EventGroup group;
+    TestEvent stays(group, 0x1);
+    volatile bool stop = false;
+    std::thread publisher([&group, &stop]() {
+        while (!stop) {
+            group.publish(0x1);
+            group.clear(0x1);
+        }
+    });
+    for (int i = 0; i < 20000; i++) {
+        TestEvent comes(group, 0x1);
+        TestEvent goes(group, 0x2);
+        if (i % 64 == 0) {
+            sched_yield();
+        }
+    }
+    stop = true;
+    publisher.join();
+    CHECK(stays.canRun(0));
+}
+
+/*
+ * TaskSimulator: the clock jumps from one deadline or event to the next,
+ * and periodic and injected work happens exactly as often as it should.
+ */
+class SimPeriodic : public PeriodicTask {
+
+public:
+    SimPeriodic() : PeriodicTask(0, 100), runs(0), lastRun(0) {}
+
+    virtual void tick(task_time_t now) {
+        runs++;
+        lastRun = now;
+    }
+
+    unsigned runs;
+    task_time_t lastRun;
+};
+
+static void testSimulator() {
+    taskClockSet(0);
+    TimerWheel wheel(0);
+    SimPeriodic periodic;
+    TestTriggered triggered;
+    Task *tasks[] = { &periodic, &triggered };
+    TaskScheduler sched(tasks, NUM_TASKS(tasks), &wheel);
+    TaskSimulator sim(sched);
+    CHECK(sim.inject(50, triggered, 0, 100, 5));
+    sim.runUntil(1000);
+    CHECK(taskClockNow() == 1000);
+    CHECK(periodic.runs == 10);
+    CHECK(periodic.lastRun == 900);
+    CHECK(triggered.runs == 5);
+    CHECK(sim.getRuns() == 15);
+}
+
+/*
+ * StaticTaskScheduler: holds its own copies of the tasks, reached through
+ * get<I>(), and runs the first one that can run in template order.
+ */
+class StaticTestTimed : public StaticTimedTask {
+
+public:
+    StaticTestTimed(task_time_t when) : StaticTimedTask(when), runs(0) {}
+    void run(task_time_t now) {
+        runs++;
+        incRunTime(10);
+    }
+
+    unsigned runs;
+};
+
+class StaticTestTriggered : public StaticTriggeredTask {
+
+public:
+    StaticTestTriggered() : runs(0) {}
+    void run(task_time_t now) {
+        resetRunnable();
+        runs++;
+    }
+
+    unsigned runs;
+};
+
+static void testStaticScheduler() {
+    StaticTestTriggered trigger;
+    StaticTaskScheduler<StaticTestTriggered, StaticTestTimed> sched(trigger, StaticTestTimed(5));
+    CHECK(sched.numTasks == 2);
+    StaticTestTriggered &t = sched.get<0>();
+    StaticTestTimed &timed = sched.get<1>();
+    CHECK(&t != &trigger);
+    CHECK(timed.getRunTime() == 5);
+
+    CHECK(!sched.dispatch(0));
+    t.setRunnable();
+    CHECK(!trigger.canRun(0));
+    CHECK(sched.dispatch(0));
+    CHECK(t.runs == 1);
+
+    // Both can run: the first goes first, one per pass.
+    t.setRunnable();
+    CHECK(sched.dispatch(5));
+    CHECK(t.runs == 2 && timed.runs == 0);
+    CHECK(sched.dispatch(5));
+    CHECK(timed.runs == 1 && timed.getRunTime() == 15);
+    CHECK(!sched.dispatch(14));
+    CHECK(sched.dispatch(15));
+    CHECK(timed.runs == 2);
+}
+
+/*
+ * A TimedTask whose run() takes a set number of ticks of the virtual
+ * clock, then moves its run time on by its period.
+ */
+class CostTimed : public TimedTask {
+
+public:
+    CostTimed(task_time_t when, task_time_t _period, task_time_t _cost) :
+      TimedTask(when), period(_period), cost(_cost) {}
+
+    virtual void run(task_time_t now) {
+        taskClockSet(taskClockNow() + cost);
+        incRunTime(period);
+    }
+
+    task_time_t period;
+    task_time_t cost;
+};
+
+#if defined(TASK_STATS)
+/*
+ * Statistics: each run is timed and its lateness measured on the virtual
+ * clock, polls and idle passes are counted, and resetStats() starts over.
+ */
+static void testStats() {
+    CostTimed task(0, 10, 3);
+    TaskScheduler sched;
+    sched.add(task, 0);
+    sched.resetStats();
+
+    taskClockSet(2);
+    CHECK(sched.dispatch(2));
+    taskClockSet(6);
+    CHECK(!sched.dispatch(6));
+    task.cost = 5;
+    taskClockSet(10);
+    CHECK(sched.dispatch(10));
+
+    TaskStats &ts = task.getStats();
+    CHECK(ts.runs == 2);
+    CHECK(ts.polls == 3);
+    CHECK(ts.minRun == 3 && ts.maxRun == 5 && ts.meanRun() == 4);
+    CHECK(ts.maxLate == 2 && ts.meanLate() == 1);
+    SchedulerStats &ss = sched.getStats();
+    CHECK(ss.passes == 3 && ss.idlePasses == 1);
+    CHECK(ss.busyTime == 8);
+    CHECK(ss.utilization(20) == 4000);
+
+    sched.resetStats();
+    CHECK(ts.runs == 0 && ts.polls == 0);
+    CHECK(ss.passes == 0 && ss.busyTime == 0);
+}
+#endif
+
+#if defined(__linux__)
+/*
+ * ThreadedTaskScheduler: every task runs as often as it triggers itself,
+ * never on two threads at once, and a pinned task only on its worker.
+ */
+class ThreadedTestTask : public TriggeredTask {
+
+public:
+    ThreadedTestTask() : runs(0), overlaps(0), strays(0), inside(0), sched(0), done(0),
+      thread(pthread_self()), pinned(false) {
+        setRunnable();
+    }
+
+    virtual void run(task_time_t now) {
+        if (taskAtomicExchange(&inside, (uint8_t)1)) {
+            overlaps++;
+        }
+        if (pinned && !pthread_equal(pthread_self(), thread)) {
+            strays++;
+        }
+        resetRunnable();
+        if (++runs < 1000) {
+            setRunnable();
+        } else if (taskAtomicAdd(done, 1u) == 10) {
+            sched->stop();
+        }
+        taskAtomicStore(&inside, (uint8_t)0);
+    }
+
+    unsigned runs;
+    unsigned overlaps;
+    unsigned strays;
+    volatile uint8_t inside;
+    ThreadedTaskScheduler *sched;
+    volatile unsigned *done;    // Tasks finished, shared.
+    pthread_t thread;           // Thread a pinned task must run on.
+    bool pinned;
+};
+
+static void testThreaded() {
+    ThreadedTestTask tasks[10];
+    Task *ptrs[10];
+    volatile unsigned done = 0;
+    for (int t = 0; t < 10; t++) {
+        ptrs[t] = &tasks[t];
+        tasks[t].done = &done;
+    }
+    ThreadedTaskScheduler sched(ptrs, 10, 4);
+    for (int t = 0; t < 10; t++) {
+        tasks[t].sched = &sched;
+    }
+    tasks[3].pinned = true;
+    sched.pin(&tasks[3], 0);
+    sched.runTasks();
+
+    CHECK(done == 10);
+    for (int t = 0; t < 10; t++) {
+        CHECK(tasks[t].runs == 1000);
+        CHECK(tasks[t].overlaps == 0);
+        CHECK(tasks[t].strays == 0);
+    }
+}
+#endif
+
+/*
+ * Round robin: each priority gets its weight's runs in a row, and those
+ * past the end of the weights one.  With statistics, a task passed over
+ * while it could run is counted as starved, in a row until it runs, and a
+ * TriggeredTask that isn't triggered isn't even asked.
+ */
+class ReadyTask : public Task {
+
+public:
+    ReadyTask() : ready(true), log(0) {}
+    virtual bool canRun(task_time_t now) { return ready; }
+    virtual void run(task_time_t now) { log->push_back(priority); }
+
+    bool ready;
+    std::vector<int> *log;
+};
+
+static void testFairness() {
+    std::vector<int> log;
+    ReadyTask tasks[3];
+    TestTriggered waiting;
+    TaskScheduler sched;
+    for (int t = 0; t < 3; t++) {
+        tasks[t].log = &log;
+        sched.add(tasks[t], t);
+    }
+    sched.add(waiting, 3);
+
+    static const uint8_t weights[] = { 2, 1 };
+    sched.setPolicy(TaskScheduler::DISPATCH_ROUND_ROBIN, weights, 2);
+    for (int i = 0; i < 8; i++) {
+        sched.dispatch(0);
+    }
+    static const int order[] = { 0, 0, 1, 2, 0, 0, 1, 2 };
+    CHECK(log == std::vector<int>(order, order + 8));
+
+#if defined(TASK_STATS)
+    sched.setPolicy(TaskScheduler::DISPATCH_PRIORITY);
+    sched.resetStats();
+    for (int i = 0; i < 3; i++) {
+        sched.dispatch(0);
+    }
+    TaskStats &low = tasks[2].getStats();
+    CHECK(low.starved == 3 && low.starving == 3 && low.maxStarved == 3);
+    CHECK(waiting.getStats().polls == 0 && waiting.getStats().starved == 0);
+
+    // Out of the running for a pass, then starved again: a new streak.
+    tasks[2].ready = false;
+    sched.dispatch(0);
+    tasks[2].ready = true;
+    sched.dispatch(0);
+    CHECK(low.starved == 4 && low.starving == 1 && low.maxStarved == 3);
+
+    tasks[0].ready = false;
+    tasks[1].ready = false;
+    sched.dispatch(0);
+    CHECK(low.runs == 1 && low.starving == 0);
+    CHECK(tasks[1].getStats().starved == 5);
+#endif
+}
+
+#if defined(TASK_EDF)
+/*
+ * Earliest deadline first: the task due to finish soonest runs first,
+ * whatever its priority, tasks without a deadline wait for those with one,
+ * and a run that finishes late is counted as a miss.
+ */
+static void testEdf() {
+    std::vector<int> log;
+    ReadyTask background;
+    background.log = &log;
+    CostTimed relaxed(0, 100, 1);
+    CostTimed urgent(0, 100, 8);
+    relaxed.setDeadline(20);
+    urgent.setDeadline(5);
+    TaskScheduler sched;
+    sched.add(background, 0);
+    sched.add(relaxed, 1);
+    sched.add(urgent, 2);
+    sched.setPolicy(TaskScheduler::DISPATCH_EDF);
+
+    taskClockSet(0);
+    CHECK(sched.dispatch(0));
+    CHECK(urgent.getRunTime() == 100 && relaxed.getRunTime() == 0);
+    CHECK(urgent.getDeadlineMisses() == 1);
+    CHECK(sched.dispatch(taskClockNow()));
+    CHECK(relaxed.getRunTime() == 100);
+    CHECK(relaxed.getDeadlineMisses() == 0);
+    CHECK(log.empty());
+    CHECK(sched.dispatch(taskClockNow()));
+    CHECK(log.size() == 1);
+    CHECK(sched.getDeadlineMisses() == 1);
+}
+#endif
+
+/*
+ * BudgetedTask: a job is done a budget's worth at a time, with higher
+ * priority work run between the slices, and a run that goes over its time
+ * budget is counted and reported to the watchdog.
+ */
+class TestBudgeted : public BudgetedTask {
+
+public:
+    TestBudgeted(task_time_t ticks, uint16_t steps) :
+      BudgetedTask(ticks, steps), items(0), cost(0), done(0), log(0) {}
+
+    virtual Result step(task_time_t now, TaskBudget &budget) {
+        if (log) {
+            log->push_back(priority);
+        }
+        while (items) {
+            if (!budget.spend()) {
+                return MORE;
+            }
+            taskClockSet(taskClockNow() + cost);
+            items--;
+            done++;
+        }
+        return DONE;
+    }
+
+    unsigned items;         // Left to do.
+    task_time_t cost;       // Clock ticks per item.
+    unsigned done;
+    std::vector<int> *log;
+};
+
+static task_time_t watchdogElapsed;
+
+static void testWatchdog(BudgetedTask &task, task_time_t elapsed) {
+    watchdogElapsed = elapsed;
+}
+
+static void testBudgeted() {
+    std::vector<int> log;
+    TestTriggered urgent;
+    urgent.log = &log;
+    urgent.order = 0;
+    TestBudgeted job(0, 3);
+    job.log = &log;
+    TaskScheduler sched;
+    sched.add(urgent, 0);
+    sched.add(job, 1);
+
+    job.items = 10;
+    job.setRunnable();
+    CHECK(sched.dispatch(0));
+    CHECK(job.done == 3);
+    urgent.setRunnable();
+    while (sched.dispatch(0)) {
+    }
+    static const int order[] = { 1, 0, 1, 1, 1 };
+    CHECK(log == std::vector<int>(order, order + 5));
+    CHECK(job.done == 10 && job.getSlices() == 3);
+    CHECK(job.getOverruns() == 0);
+
+    // Two ticks an item in a five tick budget: the third item starts at
+    // four ticks, so the run takes six.
+    taskClockSet(0);
+    job.log = 0;
+    job.setBudget(5);
+    job.cost = 2;
+    job.items = 7;
+    job.done = 0;
+    job.setRunnable();
+    CHECK(sched.dispatch(0));
+    CHECK(job.done == 3 && job.getOverruns() == 1 && job.getLongest() == 6);
+
+    // The watchdog hears of an overrun.
+    BudgetedTask::setWatchdog(testWatchdog);
+    job.cost = 9;
+    job.items = 1;
+    job.done = 0;
+    CHECK(sched.dispatch(taskClockNow()));
+    CHECK(job.done == 1 && job.getOverruns() == 2);
+    CHECK(watchdogElapsed == 9 && job.getLongest() == 9);
+    BudgetedTask::setWatchdog(0);
+}
+
+#if defined(__linux__)
+/*
+ * FdTask and LinuxEpollIdle: the idle hook sleeps until a descriptor is
+ * ready, a task is triggered or the deadline passes, and triggers the
+ * FdTask of a ready descriptor for as long as it stays ready, hang-ups
+ * included.
+ */
+class TestFd : public FdTask {
+
+public:
+    TestFd(int fd) : FdTask(fd), runs(0), events(0), got(0) {}
+
+    virtual void handle(task_time_t now, uint32_t _events) {
+        runs++;
+        events = _events;
+        char c;
+        if ((events & FD_READ) && read(getFd(), &c, 1) == 1) {
+            got++;
+        }
+    }
+
+    unsigned runs;
+    uint32_t events;
+    unsigned got;           // Bytes read.
+};
+
+static void testFdTask() {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    LinuxEpollIdle epoll;
+    TestFd reader(fds[0]);
+    TestTriggered other;
+    TaskScheduler sched;
+    sched.setIdleHook(&epoll);
+    sched.add(reader, 0);
+    sched.add(other, 1);
+    CHECK(epoll.add(reader));
+
+    // Nothing ready: sleeps out the 20 ticks.
+    uint64_t start = wallNs();
+    epoll.idle(0, 20);
+    CHECK(wallNs() - start >= 20 * 1000000000ULL / TASK_TICKS_PER_SECOND);
+    CHECK(!sched.dispatch(0));
+
+    CHECK(write(fds[1], "ab", 2) == 2);
+    start = wallNs();
+    epoll.idle(0, 10 * TASK_TICKS_PER_SECOND);
+    CHECK(wallNs() - start < 5000000000ULL);
+    CHECK(sched.dispatch(0));
+    CHECK(reader.runs == 1 && (reader.events & FdTask::FD_READ) && reader.got == 1);
+    CHECK(!sched.dispatch(0));
+    // Still a byte to read.
+    CHECK(epoll.check() == 1);
+    CHECK(sched.dispatch(0));
+    CHECK(reader.got == 2);
+    CHECK(epoll.check() == 0);
+
+    // A trigger from another thread ends the sleep.
+    std::thread trigger([&other]() {
+        struct timespec ts = { 0, 20000000 };
+        nanosleep(&ts, 0);
+        other.setRunnable();
+    });
+    start = wallNs();
+    epoll.idle(0, 10 * TASK_TICKS_PER_SECOND);
+    CHECK(wallNs() - start < 5000000000ULL);
+    trigger.join();
+    CHECK(sched.dispatch(0));
+    CHECK(other.runs == 1);
+
+    close(fds[1]);
+    CHECK(epoll.check() == 1);
+    CHECK(sched.dispatch(0));
+    CHECK(reader.events & FdTask::FD_HANGUP);
+    epoll.remove(reader);
+    close(fds[0]);
+
+    char path[] = "/tmp/fd-XXXXXX";
+    int file = mkstemp(path);
+    TestFd regular(file);
+    CHECK(!epoll.add(regular));
+    close(file);
+    unlink(path);
+}
+#endif
+
+#if defined(TASK_DEADLINE_TABLE)
+/*
+ * DeadlineTable: findDue() - vectorized where the build has SIMD - agrees
+ * with a plain canRun() walk from every entry, for run times either side of
+ * the clock wrapping, a count that leaves a partial vector, and after tasks
+ * come, go and are rescheduled; and a scheduler given the table runs its
+ * tasks as they fall due across the wrap.
+ */
+static bool findDueAgrees(DeadlineTable &table, task_time_t now) {
+    for (task_count_t from = 0; from <= table.getCount(); from++) {
+        task_count_t due = from;
+        while (due < table.getCount() && !table.getTask(due)->canRun(now)) {
+            due++;
+        }
+        if (table.findDue(now, from) != due) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testDeadlineTable() {
+    const task_time_t start = (task_time_t)0 - 100;
+    StaticDeadlineTable<64> table;
+    std::vector<TestTimed> tasks;
+    rngState = 7;
+    for (int t = 0; t < 37; t++) {
+        task_time_t when = start + rng() % 200;
+        tasks.push_back(TestTimed(when, rng() % 16));
+    }
+    for (size_t t = 0; t < tasks.size(); t++) {
+        CHECK(table.add(&tasks[t]));
+    }
+    bool ordered = true;
+    bool agrees = true;
+    for (task_count_t i = 0; i < table.getCount(); i++) {
+        ordered = ordered && table.indexOf(table.getTask(i)) == i;
+        ordered = ordered && (i == 0 || table.getPriority(i - 1) <= table.getPriority(i));
+    }
+    CHECK(ordered);
+    for (task_time_t now = start - 10; now != start + 210; now++) {
+        agrees = agrees && findDueAgrees(table, now);
+    }
+    CHECK(agrees);
+
+    for (size_t t = 0; t < tasks.size(); t += 3) {
+        table.remove(&tasks[t]);
+    }
+    for (size_t t = 1; t < tasks.size(); t += 3) {
+        tasks[t].setRunTime(start + rng() % 200);
+    }
+    CHECK(table.getCount() == tasks.size() - (tasks.size() + 2) / 3);
+    for (task_time_t now = start - 10; now != start + 210; now++) {
+        agrees = agrees && findDueAgrees(table, now);
+    }
+    CHECK(agrees);
+    for (size_t t = 0; t < tasks.size(); t++) {
+        if (t % 3) {
+            table.remove(&tasks[t]);
+        }
+    }
+    CHECK(table.getCount() == 0);
+    CHECK(table.findDue(start, 0) == 0);
+
+    StaticDeadlineTable<16> schedTable;
+    TaskScheduler sched;
+    sched.setDeadlineTable(&schedTable);
+    std::vector<CostTimed> timed;
+    for (int t = 0; t < 10; t++) {
+        timed.push_back(CostTimed(start + 20 * t, 1000, 0));
+    }
+    for (int t = 0; t < 10; t++) {
+        sched.add(timed[t], t);
+    }
+    CHECK(schedTable.getCount() == 10);
+    sched.setPolicy(TaskScheduler::DISPATCH_ALL_READY);
+    bool onTime = true;
+    for (task_time_t now = start; now != start + 200; now++) {
+        sched.dispatch(now);
+        for (int t = 0; t < 10; t++) {
+            task_time_t when = start + 20 * t;
+            onTime = onTime && timed[t].getRunTime() == (taskTimeReached(now, when) ? when + 1000 : when);
+        }
+    }
+    CHECK(onTime);
+}
+#endif
+
+/*
+ * TaskGroup: suspended tasks don't run, whether due or triggered, while
+ * others do, and on resume a TimedTask's run time is moved on by the time
+ * suspended, kept or restarted, and a trigger that came meanwhile is kept,
+ * or with RESUME_RESTART dropped - with or without a wheel.
+ */
+static void testTaskGroup() {
+    for (int mode = 0; mode < 3; mode++) {
+        for (int useWheel = 0; useWheel < 2; useWheel++) {
+            taskClockSet(0);
+            TimerWheel wheel(0);
+            TaskScheduler sched(useWheel ? &wheel : 0);
+            CostTimed timed(10, 100, 0);
+            TestTriggered triggered;
+            TestTriggered outside;
+            sched.add(timed, 0);
+            sched.add(triggered, 1);
+            sched.add(outside, 2);
+            sched.setPolicy(TaskScheduler::DISPATCH_ALL_READY);
+            Task *members[] = { &timed, &triggered };
+            TaskGroup group(sched, members, NUM_TASKS(members), "group");
+
+            taskClockSet(5);
+            group.suspend();
+            CHECK(group.isSuspended() && group.getSuspendedAt() == 5);
+            triggered.setRunnable();
+            outside.setRunnable();
+            taskClockSet(30);
+            CHECK(sched.dispatch(30));
+            CHECK(outside.runs == 1);
+            CHECK(triggered.runs == 0 && timed.getRunTime() == 10);
+
+            group.resume((TaskGroup::ResumeMode)mode);
+            CHECK(!group.isSuspended());
+            sched.dispatch(30);
+            switch (mode) {
+            case TaskGroup::RESUME_FROZEN:
+                CHECK(timed.getRunTime() == 35);
+                CHECK(triggered.runs == 1);
+                sched.dispatch(35);
+                CHECK(timed.getRunTime() == 135);
+                break;
+            case TaskGroup::RESUME_KEEP_PHASE:
+                CHECK(timed.getRunTime() == 110);
+                CHECK(triggered.runs == 1);
+                break;
+            case TaskGroup::RESUME_RESTART:
+                CHECK(timed.getRunTime() == 130);
+                CHECK(triggered.runs == 0);
+                break;
+            }
+        }
+    }
+}
+
+#if defined(TASK_TRACE)
+/*
+ * Dispatch trace: triggers and the start and end of each run are recorded
+ * in order with their times, the ring keeps the newest events, and
+ * trace2json turns a dump into a begin and end per run and a marker per
+ * trigger.
+ */
+static unsigned countOf(const std::string &text, const char *what) {
+    unsigned n = 0;
+    for (size_t at = 0; (at = text.find(what, at)) != std::string::npos; at++) {
+        n++;
+    }
+    return n;
+}
+
+static void testTrace() {
+    CostTimed timed(100, 100, 2);
+    TestTriggered triggered;
+    TaskScheduler sched;
+    sched.add(timed, 1);
+    sched.add(triggered, 2);
+    taskTrace.clear();
+    taskClockSet(100);
+    triggered.setRunnable(7);
+    CHECK(sched.dispatch(100));
+    CHECK(sched.dispatch(taskClockNow()));
+
+    static const struct {
+        uint32_t time;
+        uint16_t task;
+        uint8_t type;
+        uint8_t arg;
+    } expected[] = {
+        { 100, 2, TRACE_TRIGGER, 7 },
+        { 100, 1, TRACE_RUN, 0 },
+        { 102, 1, TRACE_DONE, 0 },
+        { 102, 2, TRACE_RUN, 0 },
+        { 102, 2, TRACE_DONE, 0 }
+    };
+    CHECK(taskTrace.getCount() == 5);
+    for (unsigned i = 0; i < 5 && i < taskTrace.getCount(); i++) {
+        TaskTraceEvent ev = taskTrace.getEvent(i);
+        CHECK(ev.time == expected[i].time && ev.task == expected[i].task);
+        CHECK(ev.type == expected[i].type && ev.arg == expected[i].arg);
+    }
+
+    char dump[] = "/tmp/trace-XXXXXX";
+    int fd = mkstemp(dump);
+    CHECK(fd >= 0);
+    taskTrace.dump(fd);
+    close(fd);
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "../trace/trace2json %s", dump);
+    FILE *json = popen(cmd, "r");
+    std::string text;
+    char buf[256];
+    size_t n;
+    while (json && (n = fread(buf, 1, sizeof(buf), json)) > 0) {
+        text.append(buf, n);
+    }
+    CHECK(json && pclose(json) == 0);
+    unlink(dump);
+    CHECK(countOf(text, "\"ph\": \"B\"") == 2);
+    CHECK(countOf(text, "\"ph\": \"E\"") == 2);
+    CHECK(countOf(text, "\"source\": 7") == 1);
+    snprintf(buf, sizeof(buf), "\"tid\": 2, \"ts\": %.3f", 100 * 1e6 / TASK_TICKS_PER_SECOND);
+    CHECK(countOf(text, buf) == 1);
+
+    for (unsigned i = 0; i < TASK_TRACE_EVENTS + 5; i++) {
+        taskTrace.record(TRACE_RUN, i);
+    }
+    CHECK(taskTrace.getCount() == TASK_TRACE_EVENTS);
+    CHECK(taskTrace.getEvent(0).task == 5);
+    CHECK(taskTrace.getEvent(TASK_TRACE_EVENTS - 1).task == TASK_TRACE_EVENTS + 4);
+    taskTrace.clear();
+    CHECK(taskTrace.getCount() == 0);
+}
+#endif
+
+/*
+ * Debugger: as the scheduler's idle task, it only writes a message out on a
+ * pass that has nothing else to run.
+ */
+static void testDebuggerIdle() {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    Debugger debugger(fds[1]);
+    TestTriggered triggered;
+    TaskScheduler sched;
+    sched.add(triggered, 0);
+    sched.setIdleTask(&debugger);
+    char buf[16];
+
+    CHECK(!sched.dispatch(0));
+    debugger.debugWrite("one");
+    triggered.setRunnable();
+    CHECK(sched.dispatch(0));
+    CHECK(triggered.runs == 1);
+    CHECK(read(fds[0], buf, sizeof(buf)) < 0);
+    CHECK(sched.dispatch(0));
+    ssize_t n = read(fds[0], buf, sizeof(buf));
+#if defined(TASK_LOG_TOKENS)
+    CHECK(n > 0);
+#else
+    CHECK(n == 4 && memcmp(buf, "one\n", 4) == 0);
+#endif
+    CHECK(!sched.dispatch(0));
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/*
+ * LogRing: messages come out in order, a full ring drops and counts them,
+ * long ones are cut short, and messages from several threads at once all
+ * arrive or are counted, each thread's in order.  The Debugger reports the
+ * drops before the next message.
+ */
+static volatile unsigned logWritersDone;
+
+static void logWriter(LogRing *ring, int writer) {
+    static const char *names[] = { "a", "b", "c", "d" };
+    for (long seq = 0; seq < 20000; seq++) {
+        ring->write(names[writer], seq);
+    }
+    taskAtomicAdd(&logWritersDone, 1u);
+}
+
+static void testLogRing() {
+    LogRing ring;
+    char buf[TASK_LOG_LINE];
+    char msg[8];
+    CHECK(ring.isEmpty());
+    CHECK(!ring.read(buf));
+    for (int i = 0; i < 10; i++) {
+        snprintf(msg, sizeof(msg), "m%d", i);
+        CHECK(ring.write(msg) == (i < TASK_LOG_SLOTS));
+    }
+    CHECK(ring.getDropped() == 10 - TASK_LOG_SLOTS);
+    for (int i = 0; i < TASK_LOG_SLOTS; i++) {
+        snprintf(msg, sizeof(msg), "m%d", i);
+        CHECK(ring.read(buf) && strcmp(buf, msg) == 0);
+    }
+    CHECK(ring.isEmpty());
+
+    char longMsg[TASK_LOG_LINE * 2];
+    memset(longMsg, 'x', sizeof(longMsg) - 1);
+    longMsg[sizeof(longMsg) - 1] = '\0';
+    CHECK(ring.write(longMsg));
+    CHECK(ring.read(buf) && strlen(buf) == TASK_LOG_LINE - 1);
+    CHECK(ring.write("Light: ", -42));
+    CHECK(ring.read(buf) && strcmp(buf, "Light: -42") == 0);
+
+    LogRing shared;
+    uint32_t received = 0;
+    long next[4] = { 0, 0, 0, 0 };
+    bool inOrder = true;
+    logWritersDone = 0;
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 4; w++) {
+        writers.push_back(std::thread(logWriter, &shared, w));
+    }
+    while (logWritersDone < 4 || !shared.isEmpty()) {
+        if (!shared.read(buf)) {
+            sched_yield();
+            continue;
+        }
+        int w = buf[0] - 'a';
+        long seq = atol(buf + 1);
+        inOrder = inOrder && w >= 0 && w < 4 && seq >= next[w];
+        next[w] = seq + 1;
+        received++;
+    }
+    for (int w = 0; w < 4; w++) {
+        writers[w].join();
+    }
+    CHECK(inOrder);
+    CHECK(received + shared.getDropped() == 4 * 20000);
+
+#if !defined(TASK_LOG_TOKENS)
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    Debugger debugger(fds[1]);
+    for (int i = 0; i < TASK_LOG_SLOTS + 2; i++) {
+        debugger.debugWrite("m", i);
+    }
+    while (debugger.canRun(0)) {
+        debugger.run(0);
+    }
+    CHECK(debugger.getDropped() == 2);
+    char out[128];
+    ssize_t n = read(fds[0], out, sizeof(out) - 1);
+    out[n > 0 ? n : 0] = '\0';
+    CHECK(strncmp(out, "-- dropped: 2\nm0\nm1\n", 20) == 0);
+    close(fds[0]);
+    close(fds[1]);
+#endif
+}
+
+/*
+ * Tokenized messages: packed as TaskToken.h describes, refused when they
+ * don't fit, and turned back into text by the host decoder in
+ * extras/tokens.  Without TASK_LOG_TOKENS, the same calls format text.
+ */
+static void testTokens() {
+#if defined(TASK_LOG_TOKENS)
+    TaskTokenBuf b(TASK_TOKEN("%d and %s"));
+    b.put(-1);
+    b.put("ab");
+    uint16_t id = taskTokenId("%d and %s");
+    static const uint8_t packed[] = { 0xff, 0xff, 0xff, 0xff, 0x0f, 'a', 'b', 0 };
+    CHECK(b.finish() == 2 + sizeof(packed));
+    CHECK(b.getData()[0] == (id & 0xff) && b.getData()[1] == id >> 8);
+    CHECK(memcmp(b.getData() + 2, packed, sizeof(packed)) == 0);
+
+    TaskTokenBuf full(TASK_TOKEN("%u"));
+    for (int i = 0; i < TASK_LOG_LINE / 5 + 1; i++) {
+        full.put(0xffffffffUL);
+    }
+    CHECK(full.finish() == 0);
+
+    char stream[] = "/tmp/tokens-XXXXXX";
+    int fd = mkstemp(stream);
+    CHECK(fd >= 0);
+    Debugger debugger(fd);
+    debugger.debugWrite(TASK_TOKEN("level %u, %x%% %c"), 300u, 0xbeef, 'z');
+    debugger.debugWrite("plain ", -5L);
+    while (debugger.canRun(0)) {
+        debugger.run(0);
+    }
+    close(fd);
+    char table[32], cmd[128];
+    snprintf(table, sizeof(table), "%s.txt", stream);
+    snprintf(cmd, sizeof(cmd), "../tokens/tokens scan tests.cpp > %s && "
+      "../tokens/tokens decode %s %s", table, table, stream);
+    FILE *decoded = popen(cmd, "r");
+    char text[128];
+    size_t n = decoded ? fread(text, 1, sizeof(text) - 1, decoded) : 0;
+    text[n] = '\0';
+    CHECK(decoded && pclose(decoded) == 0);
+    CHECK(strcmp(text, "level 300, beef% z\nplain -5\n") == 0);
+    unlink(table);
+    unlink(stream);
+#else
+    TaskTokenBuf b(TASK_TOKEN("%d and %s, %x%% %c"));
+    taskTokenPut(b, -1, "ab", 0xbeef, 'z');
+    CHECK(b.finish() == 19);
+    CHECK(strcmp((const char *)b.getData(), "-1 and ab, beef% z") == 0);
+#endif
+}
+
+#if defined(TASK_COROUTINES)
+/*
+ * CoroutineTask: sleeps end on their wake time and triggers resume a
+ * waiting coroutine, with or without a wheel; a coroutine that finds the
+ * frame pool empty fails without running; and one removed while asleep
+ * doesn't wake until it is added back.
+ */
+class TestCoroutine : public CoroutineTask {
+
+public:
+    TestCoroutine(task_time_t _period = 10, unsigned _loops = ~0U) :
+      period(_period), loops(_loops), wakes(0), triggers(0) {}
+
+    TaskCoroutine body() {
+        for (unsigned i = 0; i < loops; i++) {
+            co_await sleepFor(period);
+            wakes++;
+            lastWake = getTime();
+            co_await triggered();
+            triggers++;
+        }
+    }
+
+    task_time_t period;
+    unsigned loops;
+    unsigned wakes;
+    unsigned triggers;
+    task_time_t lastWake;
+};
+
+static void testCoroutineSleepTrigger() {
+    for (int mode = 0; mode < 2; mode++) {
+        TimerWheel wheel(0);
+        TaskScheduler sched(mode ? &wheel : 0);
+        TestCoroutine co(10);
+        sched.add(co, 0);
+
+        // Entered on the first pass, then asleep until 10.
+        CHECK(sched.dispatch(0));
+        CHECK(co.getState() == CoroutineTask::CORO_SLEEPING);
+        CHECK(!sched.dispatch(9));
+        CHECK(sched.dispatch(10));
+        CHECK(co.wakes == 1 && co.lastWake == 10);
+        CHECK(co.getState() == CoroutineTask::CORO_WAITING);
+        CHECK(!sched.dispatch(50));
+
+        // A trigger resumes it, and it sleeps again from then.
+        co.setRunnable();
+        CHECK(sched.dispatch(50));
+        CHECK(co.triggers == 1);
+        CHECK(co.getState() == CoroutineTask::CORO_SLEEPING);
+        CHECK(!sched.dispatch(59));
+        CHECK(sched.dispatch(60));
+        CHECK(co.wakes == 2 && co.lastWake == 60);
+
+        // A trigger that comes first isn't waited for.
+        co.setRunnable();
+        sched.dispatch(60);
+        CHECK(co.triggers == 2);
+        sched.remove(co);
+    }
+}
+
+/*
+ * The simulator jumps straight to each wake time, wheel or no wheel -
+ * the alarm is what nextWakeTime() sees.
+ */
+class SleepyCoroutine : public CoroutineTask {
+
+public:
+    SleepyCoroutine() : wakes(0) {}
+
+    TaskCoroutine body() {
+        while (true) {
+            co_await sleepFor(100);
+            wakes++;
+        }
+    }
+
+    unsigned wakes;
+};
+
+static void testCoroutineSimulated() {
+    for (int mode = 0; mode < 2; mode++) {
+        taskClockSet(0);
+        TimerWheel wheel(0);
+        TaskScheduler sched(mode ? &wheel : 0);
+        SleepyCoroutine co;
+        sched.add(co, 0);
+        TaskSimulator sim(sched);
+        sim.runUntil(1001);
+        CHECK(co.wakes == 10);
+        // About a jump per wake - the wheel's nextExpiry() may be early -
+        // not one per tick.
+        CHECK(sim.getJumps() < 50);
+        sched.remove(co);
+    }
+}
+
+static void testCoroutineFrames() {
+    TaskScheduler sched;
+    TestCoroutine cos[TASK_CORO_FRAMES + 1];
+    for (unsigned i = 0; i <= TASK_CORO_FRAMES; i++) {
+        cos[i].loops = i == 0 ? 1 : ~0U;
+        sched.add(cos[i], i);
+    }
+    sched.setPolicy(TaskScheduler::DISPATCH_ALL_READY);
+    sched.dispatch(0);
+    for (unsigned i = 0; i < TASK_CORO_FRAMES; i++) {
+        CHECK(cos[i].getState() == CoroutineTask::CORO_SLEEPING);
+    }
+    CHECK(cos[TASK_CORO_FRAMES].getState() == CoroutineTask::CORO_FAILED);
+    CHECK(!sched.dispatch(0));
+
+    // Once the first returns, its frame can be had again.
+    sched.dispatch(10);
+    cos[0].setRunnable();
+    sched.dispatch(10);
+    CHECK(cos[0].getState() == CoroutineTask::CORO_DONE);
+    TestCoroutine again;
+    sched.add(again, TASK_CORO_FRAMES + 1);
+    sched.dispatch(10);
+    CHECK(again.getState() == CoroutineTask::CORO_SLEEPING);
+    sched.remove(again);
+    for (unsigned i = 0; i <= TASK_CORO_FRAMES; i++) {
+        sched.remove(cos[i]);
+    }
+}
+
+static void testCoroutineRemoveSleeping() {
+    TimerWheel wheel(0);
+    TaskScheduler sched(&wheel);
+    {
+        TestCoroutine co(10);
+        sched.add(co, 0);
+        sched.dispatch(0);
+        CHECK(co.getState() == CoroutineTask::CORO_SLEEPING);
+
+        // Off the wheel while removed, back on when added.
+        sched.remove(co);
+        CHECK(wheel.isEmpty());
+        CHECK(!sched.dispatch(20));
+        CHECK(co.wakes == 0);
+        sched.add(co, 0);
+        CHECK(sched.dispatch(20));
+        CHECK(co.wakes == 1);
+
+        // Destroyed while asleep, it leaves nothing behind on the wheel.
+        co.setRunnable();
+        sched.dispatch(20);
+        CHECK(co.getState() == CoroutineTask::CORO_SLEEPING);
+        sched.remove(co);
+    }
+    CHECK(wheel.isEmpty());
+    CHECK(!sched.dispatch(100));
+}
+#endif
+
+#if defined(TASK_PREEMPT) && defined(__linux__)
+/*
+ * PreemptiveTier: a tier task made runnable while a cooperative task
+ * busy-loops runs within a tick, without waiting for the loop to end; and
+ * kick() does nothing on a tier that isn't started.
+ */
+class TierTask : public Task {
+
+public:
+    TierTask() : armed(false), ranAt(0) {}
+    virtual bool canRun(task_time_t now) { return armed; }
+    virtual void run(task_time_t now) {
+        armed = false;
+        ranAt = wallNs();
+    }
+
+    volatile bool armed;
+    volatile uint64_t ranAt;
+};
+
+class BusyTask : public TriggeredTask {
+
+public:
+    BusyTask(TierTask &_tier) : tier(_tier), armedAt(0), doneAt(0) {}
+    virtual void run(task_time_t now) {
+        resetRunnable();
+        armedAt = wallNs();
+        tier.armed = true;
+        while (wallNs() - armedAt < 50000000ULL) {
+        }
+        doneAt = wallNs();
+    }
+
+    TierTask &tier;
+    uint64_t armedAt;
+    uint64_t doneAt;
+};
+
+static void testPreemptiveTier() {
+    TierTask fast;
+    Task *tierTasks[] = { &fast };
+    PreemptiveTier tier(tierTasks, NUM_TASKS(tierTasks));
+
+    // Not started, so there is no handler for the signal to reach.
+    tier.kick();
+    CHECK(tier.getRuns() == 0);
+
+    BusyTask busy(fast);
+    TaskScheduler sched;
+    sched.add(busy, 0);
+    busy.setRunnable();
+    CHECK(tier.start(1000));
+    CHECK(sched.dispatch(0));
+    tier.stop();
+
+    // A tick is 1 ms; allow a few more for the host to deliver it.
+    CHECK(fast.ranAt != 0);
+    CHECK(fast.ranAt < busy.doneAt);
+    CHECK(fast.ranAt - busy.armedAt < 5000000ULL);
+    CHECK(tier.getRuns() == 1);
+    CHECK(tier.getTicks() >= 10);
+    tier.kick();
+    CHECK(tier.getRuns() == 1);
+}
+#endif
+
+static const struct {
+    const char *name;
+    void (*fn)();
+} tests[] = {
+    { "wheel-boundaries", testWheelBoundaries },
+    { "wheel-single", testWheelSingle },
+    { "wheel-random", testWheelRandom },
+    { "wheel-stepping", testWheelStepping },
+    { "ready-bitmap", testReadyBitmap },
+    { "ready-queue", testReadyQueue },
+    { "overrun-policies", testOverrunPolicies },
+    { "channel", testChannel },
+    { "equal-priorities", testEqualPriorities },
+    { "equal-priorities-one-per-pass", testEqualPrioritiesOnePerPass },
+    { "event-group", testEventGroup },
+    { "simulator", testSimulator },
+    { "static-scheduler", testStaticScheduler },
+#if defined(TASK_STATS)
+    { "stats", testStats },
+#endif
+#if defined(__linux__)
+    { "threaded", testThreaded },
+#endif
+    { "fairness", testFairness },
+#if defined(TASK_EDF)
+    { "edf", testEdf },
+#endif
+    { "budgeted", testBudgeted },
+#if defined(__linux__)
+    { "fd-task", testFdTask },
+#endif
+    { "task-group", testTaskGroup },
+#if defined(TASK_DEADLINE_TABLE)
+    { "deadline-table", testDeadlineTable },
+#endif
+#if defined(TASK_TRACE)
+    { "trace", testTrace },
+#endif
+    { "debugger-idle", testDebuggerIdle },
+    { "log-ring", testLogRing },
+    { "tokens", testTokens },
+#if defined(TASK_PREEMPT) && defined(__linux__)
+    { "preemptive-tier", testPreemptiveTier },
+#endif
+#if defined(TASK_COROUTINES)
+    { "coroutine-sleep-trigger", testCoroutineSleepTrigger },
+    { "coroutine-simulated", testCoroutineSimulated },
+    { "coroutine-frames", testCoroutineFrames },
+    { "coroutine-remove-sleeping", testCoroutineRemoveSleeping },
+#endif
+};
+#define NUM_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+int main(int argc, char **argv) {
+    unsigned run = 0;
+    for (size_t t = 0; t < NUM_TESTS; t++) {
+        bool wanted = argc < 2;
+        for (int a = 1; a < argc; a++) {
+            wanted = wanted || strcmp(argv[a], tests[t].name) == 0;
+        }
+        if (!wanted) {
+            continue;
+        }
+        testName = tests[t].name;
+        unsigned before = failures;
+        taskClockSet(0);
+        tests[t].fn();
+        printf("%-32s %s\n", testName, failures == before ? "ok" : "FAILED");
+        run++;
+    }
+    printf("%u tests, %u checks, %u failed\n", run, checks, failures);
+    return failures || !run ? 1 : 0;
+}
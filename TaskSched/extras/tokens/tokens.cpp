@@ -0,0 +1,311 @@
+/*
+ * Host tool for tokenized Debugger output - see TaskToken.h.
+ */
+
+/*
+ *   tokens scan FILE... > table
+ *
+ * finds every TASK_TOKEN("...") in the given sources and writes a table of
+ * their IDs and format strings.  Scan the sketch and the library together,
+ * as the Debugger has tokens of its own.  Two different strings with the
+ * same ID are an error - reword one of them.
+ *
+ *   tokens decode TABLE [STREAM]
+ *
+ * reads a stream of tokenized messages - from a file or an already set up
+ * serial device, by default stdin - and prints them as text, one per line.
+ * An unknown ID is reported and skipped a byte at a time until the stream
+ * makes sense again.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include "TaskToken.h"
+
+/*
+ * Turn the text of a C string literal into the string it stands for.
+ */
+static std::string unescape(const std::string &lit) {
+    std::string s;
+    for (size_t i = 0; i < lit.size(); i++) {
+        char c = lit[i];
+        if (c != '\\' || i + 1 >= lit.size()) {
+            s += c;
+            continue;
+        }
+        c = lit[++i];
+        switch (c) {
+        case 'n': s += '\n'; break;
+        case 't': s += '\t'; break;
+        case 'r': s += '\r'; break;
+        case 'a': s += '\a'; break;
+        case 'b': s += '\b'; break;
+        case 'f': s += '\f'; break;
+        case 'v': s += '\v'; break;
+        case 'x': {
+            int v = 0;
+            while (i + 1 < lit.size() && isxdigit((unsigned char)lit[i + 1])) {
+                char h = lit[++i];
+                v = v * 16 + (isdigit((unsigned char)h) ? h - '0' : (tolower(h) - 'a' + 10));
+            }
+            s += (char)v;
+            break;
+        }
+        default:
+            if (c >= '0' && c <= '7') {
+                int v = c - '0';
+                for (int n = 1; n < 3 && i + 1 < lit.size() && lit[i + 1] >= '0' && lit[i + 1] <= '7'; n++) {
+                    v = v * 8 + (lit[++i] - '0');
+                }
+                s += (char)v;
+            } else {
+                s += c;
+            }
+            break;
+        }
+    }
+    return s;
+}
+
+static bool readFile(const char *path, std::string &text) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        text.append(buf, n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static int scan(int nfiles, char **files) {
+    static const char marker[] = "TASK_TOKEN(";
+    std::map<uint16_t, std::string> table;
+    int status = 0;
+
+    for (int f = 0; f < nfiles; f++) {
+        std::string text;
+        if (!readFile(files[f], text)) {
+            return 1;
+        }
+        size_t at = 0;
+        while ((at = text.find(marker, at)) != std::string::npos) {
+            at += sizeof(marker) - 1;
+            size_t p = at;
+            while (p < text.size() && isspace((unsigned char)text[p])) {
+                p++;
+            }
+            if (p >= text.size() || text[p] != '"') {
+                // E.g. the macro's own definition.
+                continue;
+            }
+            size_t end = ++p;
+            while (end < text.size() && text[end] != '"') {
+                end += text[end] == '\\' ? 2 : 1;
+            }
+            if (end >= text.size()) {
+                break;
+            }
+            std::string lit = text.substr(p, end - p);
+            uint16_t id = taskTokenId(unescape(lit).c_str());
+            std::map<uint16_t, std::string>::iterator it = table.find(id);
+            if (it == table.end()) {
+                table[id] = lit;
+            } else if (it->second != lit) {
+                fprintf(stderr, "%s: \"%s\" has the same ID, %04x, as \"%s\"\n",
+                  files[f], lit.c_str(), id, it->second.c_str());
+                status = 1;
+            }
+            at = end;
+        }
+    }
+
+    for (std::map<uint16_t, std::string>::iterator it = table.begin(); it != table.end(); ++it) {
+        printf("%04x\t%s\n", it->first, it->second.c_str());
+    }
+    return status;
+}
+
+static bool loadTable(const char *path, std::map<uint16_t, std::string> &table) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        char *tab = strchr(line, '\t');
+        if (!tab) {
+            continue;
+        }
+        size_t len = strlen(tab + 1);
+        if (len && tab[len] == '\n') {
+            tab[len] = '\0';
+        }
+        table[(uint16_t)strtoul(line, 0, 16)] = unescape(tab + 1);
+    }
+    fclose(fp);
+    return true;
+}
+
+/*
+ * Read a base 128 integer.
+ */
+static bool readInt(FILE *in, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int c = getc(in);
+        if (c == EOF) {
+            return false;
+        }
+        v |= (uint32_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return true;
+}
+
+/*
+ * Read a NUL terminated string.
+ */
+static bool readStr(FILE *in, std::string &s) {
+    int c;
+    s.clear();
+    while ((c = getc(in)) != EOF) {
+        if (c == '\0') {
+            return true;
+        }
+        s += (char)c;
+    }
+    return false;
+}
+
+/*
+ * Print one message, reading its arguments as the format asks for them.
+ * return - false if the stream ended part way through.
+ */
+static bool printMessage(FILE *in, const std::string &fmt) {
+    for (size_t i = 0; i < fmt.size(); i++) {
+        if (fmt[i] != '%' || i + 1 >= fmt.size()) {
+            putchar(fmt[i]);
+            continue;
+        }
+        char conv = fmt[++i];
+        uint32_t v;
+        std::string s;
+        switch (conv) {
+        case '%':
+            putchar('%');
+            break;
+        case 'd':
+        case 'i':
+            if (!readInt(in, v)) {
+                return false;
+            }
+            printf("%d", (int32_t)v);
+            break;
+        case 'u':
+            if (!readInt(in, v)) {
+                return false;
+            }
+            printf("%u", v);
+            break;
+        case 'x':
+            if (!readInt(in, v)) {
+                return false;
+            }
+            printf("%x", v);
+            break;
+        case 'X':
+            if (!readInt(in, v)) {
+                return false;
+            }
+            printf("%X", v);
+            break;
+        case 'c':
+            if (!readInt(in, v)) {
+                return false;
+            }
+            putchar((char)v);
+            break;
+        case 's':
+            if (!readStr(in, s)) {
+                return false;
+            }
+            fputs(s.c_str(), stdout);
+            break;
+        default:
+            putchar('%');
+            putchar(conv);
+            break;
+        }
+    }
+    return true;
+}
+
+static int decode(const char *tablePath, const char *streamPath) {
+    std::map<uint16_t, std::string> table;
+    if (!loadTable(tablePath, table)) {
+        return 1;
+    }
+    table[0] = "%s";
+    FILE *in = stdin;
+    if (streamPath && (in = fopen(streamPath, "rb")) == 0) {
+        perror(streamPath);
+        return 1;
+    }
+
+    int lo = getc(in);
+    int hi;
+    bool lost = false;
+    while (lo != EOF && (hi = getc(in)) != EOF) {
+        uint16_t id = lo | hi << 8;
+        std::map<uint16_t, std::string>::iterator it = table.find(id);
+        if (it == table.end()) {
+            // Out of step - slide along a byte.
+            if (!lost) {
+                printf("-- unknown token %04x\n", id);
+                lost = true;
+            }
+            lo = hi;
+            continue;
+        }
+        lost = false;
+        bool whole = printMessage(in, it->second);
+        putchar('\n');
+        fflush(stdout);
+        if (!whole) {
+            break;
+        }
+        lo = getc(in);
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+      "usage: %s scan FILE... > table\n"
+      "       %s decode TABLE [STREAM]\n", prog, prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && strcmp(argv[1], "scan") == 0) {
+        return scan(argc - 2, argv + 2);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "decode") == 0) {
+        return decode(argv[2], argc == 4 ? argv[3] : 0);
+    }
+    usage(argv[0]);
+    return 2;
+}
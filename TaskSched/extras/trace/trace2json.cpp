@@ -0,0 +1,195 @@
+/*
+ * Convert a taskTrace.dump() into Chrome trace-event JSON.
+ */
+
+/*
+ *   trace2json [-n names] [dump] > trace.json
+ *
+ * reads a dump - from a file, or stdin - and writes JSON that
+ * chrome://tracing and ui.perfetto.dev open as a timeline: one track per
+ * task showing its runs, an "idle" track showing time in the idle hook, and
+ * a marker on a task's track for each trigger, with its source.  Lines
+ * before the "# tasktrace" header, e.g. other serial output, are skipped.
+ *
+ * names is an optional file of "priority name" lines to label the tracks.
+ *
+ * Times in the dump are 32 bit clock ticks; they are unwrapped on the
+ * assumption that no two consecutive events are 2^32 ticks apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+// Track ids - tasks are offset so priority 0 doesn't land on the idle one.
+#define IDLE_TID 0
+#define TASK_TID(task) ((task) + 1)
+
+static std::map<unsigned, std::string> names;
+
+static bool loadNames(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned task;
+        char name[200];
+        if (sscanf(line, "%u %199[^\n]", &task, name) == 2) {
+            names[task] = name;
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+static std::string taskName(unsigned task) {
+    std::map<unsigned, std::string>::iterator it = names.find(task);
+    if (it != names.end()) {
+        return it->second;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "task %u", task);
+    return buf;
+}
+
+/*
+ * Write a string as a JSON string.
+ */
+static void putJson(const std::string &s) {
+    putchar('"');
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+static bool first = true;
+
+/*
+ * Start an event object, leaving it open for any extra fields.
+ */
+static void event(const char *ph, const std::string &name, double ts, unsigned tid) {
+    printf("%s\n    {\"ph\": \"%s\", \"name\": ", first ? "" : ",", ph);
+    putJson(name);
+    printf(", \"pid\": 1, \"tid\": %u, \"ts\": %.3f", tid, ts);
+    first = false;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n names] [dump]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int a = 1;
+    if (a + 1 < argc && strcmp(argv[a], "-n") == 0) {
+        if (!loadNames(argv[a + 1])) {
+            return 1;
+        }
+        a += 2;
+    }
+    if (argc - a > 1 || (a < argc && argv[a][0] == '-')) {
+        usage(argv[0]);
+    }
+    FILE *in = stdin;
+    if (a < argc && (in = fopen(argv[a], "r")) == 0) {
+        perror(argv[a]);
+        return 1;
+    }
+
+    char line[256];
+    unsigned long hz = 0;
+    while (fgets(line, sizeof(line), in)) {
+        if (sscanf(line, "# tasktrace %lu", &hz) == 1) {
+            break;
+        }
+    }
+    if (!hz) {
+        fprintf(stderr, "%s: no tasktrace header\n", argv[0]);
+        return 1;
+    }
+
+    printf("{\n  \"displayTimeUnit\": \"ns\",\n  \"traceEvents\": [");
+    event("M", "thread_name", 0, IDLE_TID);
+    printf(", \"args\": {\"name\": \"idle\"}}");
+
+    std::map<unsigned, bool> labelled; // Tracks named so far.
+    std::map<unsigned, bool> open;     // Tracks with a run or idle spell open.
+    uint64_t base = 0;
+    uint32_t last = 0;
+    bool any = false;
+    double ts = 0;
+    while (fgets(line, sizeof(line), in)) {
+        unsigned long time;
+        char type;
+        unsigned task, arg;
+        if (sscanf(line, "%lu %c %u %u", &time, &type, &task, &arg) != 4) {
+            break;
+        }
+        if (any && (uint32_t)time < last) {
+            base += (uint64_t)1 << 32;
+        }
+        last = time;
+        any = true;
+        ts = (double)(base + (uint32_t)time) * 1e6 / hz;
+
+        unsigned tid = type == 'I' || type == 'W' ? IDLE_TID : TASK_TID(task);
+        if (tid != IDLE_TID && !labelled[tid]) {
+            event("M", "thread_name", 0, tid);
+            printf(", \"args\": {\"name\": ");
+            putJson(taskName(task));
+            printf("}}");
+            labelled[tid] = true;
+        }
+
+        switch (type) {
+        case 'R':
+        case 'I':
+            if (open[tid]) {
+                // The end was lost - e.g. recording was stopped part way.
+                event("E", "", ts, tid);
+                printf("}");
+            }
+            event("B", tid == IDLE_TID ? "idle" : taskName(task), ts, tid);
+            printf("}");
+            open[tid] = true;
+            break;
+        case 'D':
+        case 'W':
+            // Skip ends whose start has been overwritten.
+            if (open[tid]) {
+                event("E", "", ts, tid);
+                printf("}");
+                open[tid] = false;
+            }
+            break;
+        case 'T':
+            event("i", "trigger", ts, tid);
+            printf(", \"s\": \"t\", \"args\": {\"source\": %u}}", arg);
+            break;
+        }
+    }
+
+    // Close anything still open at the end of the dump.
+    for (std::map<unsigned, bool>::iterator it = open.begin(); it != open.end(); ++it) {
+        if (it->second) {
+            event("E", "", ts, it->first);
+            printf("}");
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}